@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_archive.h"
+#include "../Utils/utils.h"
+
+#define FIXTURE_MAX (16*1024)
+#define BLOCK 512
+
+typedef struct { const wchar_t* name; int isDir; ULONGLONG size; } Member;
+
+static void wr16(BYTE* p, WORD v) { p[0] = (BYTE)v; p[1] = (BYTE)(v >> 8); }
+static void wr32(BYTE* p, DWORD v) { wr16(p, (WORD)v); wr16(p + 2, (WORD)(v >> 16)); }
+static void wr64(BYTE* p, ULONGLONG v) { wr32(p, (DWORD)v); wr32(p + 4, (DWORD)(v >> 32)); }
+
+static int write_fixture(const wchar_t* path, const BYTE* data, size_t len) {
+    FILE* f = NULL;
+    if (_wfopen_s(&f, path, L"wb") != 0 || !f) { fwprintf(stderr, L"Failed to create %s\n", path); return 0; }
+    size_t n = fwrite(data, 1, len, f);
+    fclose(f);
+    return n == len;
+}
+
+// Lists the fixture and compares it with the expected members, in order
+static int check_members(const wchar_t* path, int kind, const Member* expected, int total, const wchar_t* label) {
+    ArchiveEnum e;
+    if (!ae_open(&e, path, kind)) { wprintf(L"[FAIL] %s: ae_open failed\n", label); return 1; }
+    int failed = 0, i = 0;
+    while (ae_next(&e)) {
+        if (i >= total) { wprintf(L"[FAIL] %s: unexpected member '%s'\n", label, e.name); failed++; continue; }
+        if (wcscmp(e.name, expected[i].name) != 0 || e.isDir != expected[i].isDir || e.size != expected[i].size) {
+            wprintf(L"[FAIL] %s %d: expected '%s' dir=%d size=%llu, got '%s' dir=%d size=%llu\n", label, i,
+                    expected[i].name, expected[i].isDir, expected[i].size, e.name, e.isDir, e.size);
+            failed++;
+        } else {
+            wprintf(L"[PASS] %s %d\n", label, i);
+        }
+        i++;
+    }
+    if (i < total) { wprintf(L"[FAIL] %s: listing ended after %d of %d members\n", label, i, total); failed++; }
+    ae_close(&e);
+    return failed;
+}
+
+/* -------- zip -------- */
+static size_t zip_cdir(BYTE* p, const char* name, WORD flags, DWORD usize, const BYTE* extra, WORD xl) {
+    WORD nl = (WORD)strlen(name);
+    memset(p, 0, 46);
+    wr32(p, 0x02014b50);
+    wr16(p + 8, flags);
+    wr16(p + 14, 0x21); // 1980-01-01
+    wr32(p + 24, usize);
+    wr16(p + 28, nl);
+    wr16(p + 30, xl);
+    memcpy(p + 46, name, nl);
+    if (xl) memcpy(p + 46 + nl, extra, xl);
+    return 46 + nl + xl;
+}
+
+static size_t zip_eocd(BYTE* p, WORD entries, DWORD cdSize, DWORD cdOff, const char* comment) {
+    WORD cl = (WORD)strlen(comment);
+    memset(p, 0, 22);
+    wr32(p, 0x06054b50);
+    wr16(p + 8, entries);
+    wr16(p + 10, entries);
+    wr32(p + 12, cdSize);
+    wr32(p + 16, cdOff);
+    wr16(p + 20, cl);
+    memcpy(p + 22, comment, cl);
+    return 22 + cl;
+}
+
+int test_archive_zip(void) {
+    wprintf(L"=== Tests for zip listing ===\n");
+
+    static BYTE buf[FIXTURE_MAX];
+    wchar_t path[MAX_PATH], dir[MAX_PATH];
+    GetTempPathW(MAX_PATH, dir);
+    path_concat(path, MAX_PATH, dir, L"filterfilesmt_test.zip");
+    int failed = 0;
+
+    // Central directory at offset 0, end record found behind a trailing comment
+    size_t n = 0;
+    n += zip_cdir(buf + n, "dir/a.txt", 0x0800, 3, NULL, 0);
+    n += zip_cdir(buf + n, "../evil.txt", 0, 1, NULL, 0);
+    n += zip_cdir(buf + n, "./b.txt", 0, 4, NULL, 0);
+    n += zip_cdir(buf + n, "sub/", 0, 0, NULL, 0);
+    n += zip_eocd(buf + n, 4, (DWORD)n, 0, "a trailing comment");
+    const Member plain[] = { {L"dir/a.txt", 0, 3}, {L"b.txt", 0, 4}, {L"sub", 1, 0} };
+    if (!write_fixture(path, buf, n)) return 1;
+    failed += check_members(path, ARCHIVE_ZIP, plain, 3, L"zip");
+
+    // ZIP64: counts and offsets in the zip64 end record, size in the extra field
+    BYTE extra[12];
+    wr16(extra, 0x0001); wr16(extra + 2, 8); wr64(extra + 4, 5000000000ULL);
+    n = zip_cdir(buf, "big.bin", 0, 0xFFFFFFFF, extra, sizeof(extra));
+    size_t cdSize = n, z = n;
+    memset(buf + z, 0, 56);
+    wr32(buf + z, 0x06064b50);
+    wr64(buf + z + 4, 44);
+    wr64(buf + z + 24, 1);
+    wr64(buf + z + 32, 1);
+    wr64(buf + z + 40, cdSize);
+    wr64(buf + z + 48, 0);
+    n += 56;
+    memset(buf + n, 0, 20);
+    wr32(buf + n, 0x07064b50);
+    wr64(buf + n + 8, z);
+    wr32(buf + n + 16, 1);
+    n += 20;
+    n += zip_eocd(buf + n, 0xFFFF, 0xFFFFFFFF, 0xFFFFFFFF, "");
+    const Member big[] = { {L"big.bin", 0, 5000000000ULL} };
+    if (!write_fixture(path, buf, n)) return failed + 1;
+    failed += check_members(path, ARCHIVE_ZIP, big, 1, L"zip64");
+
+    // No end record at all
+    memset(buf, 'z', 1000);
+    ArchiveEnum e;
+    if (!write_fixture(path, buf, 1000)) return failed + 1;
+    if (ae_open(&e, path, ARCHIVE_ZIP)) { wprintf(L"[FAIL] zip without end record opened\n"); ae_close(&e); failed++; }
+    else if (e.fileSize != 1000) { wprintf(L"[FAIL] fileSize not kept after a failed open\n"); failed++; }
+    else wprintf(L"[PASS] zip without end record rejected\n");
+
+    DeleteFileW(path);
+    return failed;
+}
+
+/* -------- tar -------- */
+static void tar_header(BYTE* h, const char* name, ULONGLONG size, char type, const char* magic, const char* prefix) {
+    memset(h, 0, BLOCK);
+    memcpy(h, name, strlen(name));
+    snprintf((char*)h + 100, 8, "%07o", 0644);
+    snprintf((char*)h + 124, 12, "%011llo", size);
+    snprintf((char*)h + 136, 12, "%011o", 1000000000);
+    h[156] = (BYTE)type;
+    if (magic) memcpy(h + 257, magic, 8);
+    if (prefix) memcpy(h + 345, prefix, strlen(prefix));
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < BLOCK; i++) sum += h[i];
+    snprintf((char*)h + 148, 7, "%06o", sum);
+}
+
+// Header plus data rounded up to whole blocks
+static size_t tar_member(BYTE* p, const char* name, char type, const char* data, const char* magic, const char* prefix) {
+    size_t len = data ? strlen(data) : 0;
+    tar_header(p, name, len, type, magic, prefix);
+    memset(p + BLOCK, 0, (len + BLOCK - 1) / BLOCK * BLOCK);
+    if (len) memcpy(p + BLOCK, data, len);
+    return BLOCK + (len + BLOCK - 1) / BLOCK * BLOCK;
+}
+
+int test_archive_tar(void) {
+    wprintf(L"=== Tests for tar listing ===\n");
+
+    static BYTE buf[FIXTURE_MAX];
+    char longName[160], pax[64];
+    wchar_t path[MAX_PATH], dir[MAX_PATH], longWide[160];
+    GetTempPathW(MAX_PATH, dir);
+    path_concat(path, MAX_PATH, dir, L"filterfilesmt_test.tar");
+    int failed = 0;
+
+    memcpy(longName, "deep/", 5);          // past the 100 bytes of a header name
+    memset(longName + 5, 'n', 120);
+    memcpy(longName + 125, ".txt", 5);
+    MultiByteToWideChar(CP_UTF8, 0, longName, -1, longWide, 160);
+    snprintf(pax, sizeof(pax), "%d path=pax/name.txt\n", (int)strlen(" path=pax/name.txt\n") + 2);
+
+    size_t n = 0;
+    n += tar_member(buf + n, "a.txt", '0', "abc", "ustar\0" "00", NULL);
+    n += tar_member(buf + n, "././@LongLink", 'L', longName, "ustar  ", NULL);       // GNU long name
+    n += tar_member(buf + n, "deep/truncated", '0', NULL, "ustar  ", NULL);
+    n += tar_member(buf + n, "PaxHeaders/name.txt", 'x', pax, "ustar\0" "00", NULL); // pax path=
+    n += tar_member(buf + n, "ignored.txt", '0', NULL, "ustar\0" "00", NULL);
+    n += tar_member(buf + n, "n.txt", '0', NULL, "ustar\0" "00", "pre/fix");         // ustar prefix
+    n += tar_member(buf + n, "gnu.txt", '0', NULL, "ustar  ", "14604275023");        // old GNU: atime, not a prefix
+    n += tar_member(buf + n, "../up.txt", '0', "x", "ustar\0" "00", NULL);
+    n += tar_member(buf + n, "dir/", '5', NULL, "ustar\0" "00", NULL);
+    n += tar_member(buf + n, "after.txt", '0', NULL, "ustar\0" "00", NULL);
+    buf[n - BLOCK] ^= 1;                                                             // checksum no longer matches
+    memset(buf + n, 0, 2 * BLOCK); n += 2 * BLOCK;
+
+    const Member expected[] = {
+        {L"a.txt", 0, 3},
+        {longWide, 0, 0},
+        {L"pax/name.txt", 0, 0},
+        {L"pre/fix/n.txt", 0, 0},
+        {L"gnu.txt", 0, 0},
+        {L"dir", 1, 0},
+    };
+    if (!write_fixture(path, buf, n)) return 1;
+    failed += check_members(path, ARCHIVE_TAR, expected, sizeof(expected) / sizeof(*expected), L"tar");
+
+    // An empty archive opens; a first block that is not a header does not
+    ArchiveEnum e;
+    memset(buf, 0, 2 * BLOCK);
+    if (!write_fixture(path, buf, 2 * BLOCK)) return failed + 1;
+    if (!ae_open(&e, path, ARCHIVE_TAR)) { wprintf(L"[FAIL] empty tar rejected\n"); failed++; }
+    else { if (ae_next(&e)) { wprintf(L"[FAIL] empty tar has members\n"); failed++; } ae_close(&e); }
+
+    memset(buf, 'x', 2 * BLOCK);
+    if (!write_fixture(path, buf, 2 * BLOCK)) return failed + 1;
+    if (ae_open(&e, path, ARCHIVE_TAR)) { wprintf(L"[FAIL] tar without a valid header opened\n"); ae_close(&e); failed++; }
+    else wprintf(L"[PASS] tar without a valid header rejected\n");
+
+    DeleteFileW(path);
+    return failed;
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_ARCHIVE_H
+#define TEST_ARCHIVE_H
+
+#include "../Utils/archive_enum.h"
+
+int test_archive_zip(void);
+int test_archive_tar(void);
+
+#endif // TEST_ARCHIVE_H
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include "test_disk_usage.h"
+
+#define DU_CHILDREN 200
+
+typedef struct {
+    DiskUsage* d;
+    DuNode* node;
+} DuThreadArg;
+
+// Lists one top-level directory: its children are created first, the directory itself
+// finishes next, and the children finish afterwards, so the rollup happens on the last child.
+static DWORD WINAPI du_lister(LPVOID param) {
+    DuThreadArg* a = (DuThreadArg*)param;
+    DuNode* kids[DU_CHILDREN];
+    for (int i = 0; i < DU_CHILDREN; i++) kids[i] = du_node(a->d, a->node, L"child");
+    du_finish_dir(a->d, a->node, 1, 1);
+    for (int i = DU_CHILDREN - 1; i >= 0; i--) {
+        if (kids[i]) du_finish_dir(a->d, kids[i], 10, 2);
+    }
+    return 0;
+}
+
+int test_du_rollup(void) {
+    wprintf(L"=== Disk Usage Rollup Test ===\n");
+
+    DiskUsage d;
+    du_init(&d, 1); // keep the root and its direct children for the report
+
+    DuNode* root = du_node(&d, NULL, L"root");
+    if (!root) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+
+    HANDLE threads[NUM_DU_THREADS];
+    DuThreadArg args[NUM_DU_THREADS];
+    for (int i = 0; i < NUM_DU_THREADS; i++) {
+        args[i].d = &d;
+        args[i].node = du_node(&d, root, L"top");
+    }
+    // The root's own listing ends while its subtrees are still running
+    du_finish_dir(&d, root, 5, 1);
+    for (int i = 0; i < NUM_DU_THREADS; i++) {
+        threads[i] = CreateThread(NULL, 0, du_lister, &args[i], 0, NULL);
+    }
+
+    WaitForMultipleObjects(NUM_DU_THREADS, threads, TRUE, INFINITE);
+    for (int i = 0; i < NUM_DU_THREADS; i++) CloseHandle(threads[i]);
+
+    int failed = 0;
+    LONG64 expectBytes = 5 + (LONG64)NUM_DU_THREADS * (1 + DU_CHILDREN * 10);
+    LONG64 expectFiles = 1 + (LONG64)NUM_DU_THREADS * (1 + DU_CHILDREN * 2);
+    if (root->pending != 0 || root->bytes != expectBytes || root->files != expectFiles) {
+        wprintf(L"[FAIL] Root: pending=%ld bytes=%lld files=%lld, expected 0/%lld/%lld\n",
+                root->pending, root->bytes, root->files, expectBytes, expectFiles);
+        failed++;
+    }
+
+    // Deeper nodes are freed as soon as they are rolled up
+    int kept = 0;
+    for (DuNode* n = d.done; n; n = n->next) {
+        kept++;
+        if (n->depth > 1) { wprintf(L"[FAIL] Node at depth %d kept for the report\n", n->depth); failed++; }
+        if (n->depth == 1 && (n->bytes != 1 + DU_CHILDREN * 10 || n->files != 1 + DU_CHILDREN * 2)) {
+            wprintf(L"[FAIL] Subtree total bytes=%lld files=%lld\n", n->bytes, n->files);
+            failed++;
+        }
+    }
+    if (kept != NUM_DU_THREADS + 1) {
+        wprintf(L"[FAIL] Expected %d reported nodes, got %d\n", NUM_DU_THREADS + 1, kept);
+        failed++;
+    }
+
+    du_free(&d);
+
+    if (!failed) wprintf(L"[PASS] Disk usage rollup test passed.\n");
+    return failed;
+}
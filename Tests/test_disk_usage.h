@@ -0,0 +1,10 @@
+#ifndef TEST_DISK_USAGE_H
+#define TEST_DISK_USAGE_H
+
+#include "../Utils/disk_usage.h"
+
+#define NUM_DU_THREADS 8
+
+int test_du_rollup(void);
+
+#endif // TEST_DISK_USAGE_H
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include "test_id_set.h"
+
+static FileId fid(ULONGLONG lo, ULONGLONG hi) { FileId id; id.lo = lo; id.hi = hi; return id; }
+
+int test_idset_st(void) {
+    wprintf(L"=== Single-threaded IdSet Test ===\n");
+
+    IdSet s;
+    if (!idset_init(&s)) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+
+    const int N = 100000; // well past the initial shard capacity
+    int failed = 0;
+
+    for (int i = 0; i < N; i++) {
+        if (!idset_add(&s, 1, fid((ULONGLONG)i, 0))) { wprintf(L"[FAIL] id %d reported as seen on first add\n", i); failed++; }
+    }
+    for (int i = 0; i < N; i++) {
+        if (idset_add(&s, 1, fid((ULONGLONG)i, 0))) { wprintf(L"[FAIL] id %d reported as new on second add\n", i); failed++; }
+    }
+    // same file id on another volume is a different file
+    if (!idset_add(&s, 2, fid(0, 0))) { wprintf(L"[FAIL] volume not part of the key\n"); failed++; }
+    // ReFS ids can share the low 64 bits
+    if (!idset_add(&s, 1, fid(5, 1))) { wprintf(L"[FAIL] high half of the id not part of the key\n"); failed++; }
+    if (idset_add(&s, 1, fid(5, 1))) { wprintf(L"[FAIL] 128-bit id reported as new on second add\n"); failed++; }
+
+    if (idset_count(&s) != (size_t)N + 2) {
+        wprintf(L"[FAIL] Expected %d entries, got %zu\n", N + 2, idset_count(&s));
+        failed++;
+    }
+
+    idset_destroy(&s);
+
+    if (!failed) wprintf(L"[PASS] Single-threaded IdSet test passed.\n");
+    return failed;
+}
+
+int test_idset_spill(void) {
+    wprintf(L"=== Spilling IdSet Test ===\n");
+
+    IdSet s;
+    if (!idset_init(&s)) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+    if (!idset_set_budget(&s, 1000, NULL)) { wprintf(L"[FAIL] idset_set_budget\n"); idset_destroy(&s); return 1; }
+
+    const int N = 50000; // ~150 spills, enough to force run merges
+    int failed = 0;
+
+    for (int i = 0; i < N; i++) {
+        if (!idset_add(&s, 1, fid((ULONGLONG)i * 7, 0))) { wprintf(L"[FAIL] id %d reported as seen on first add\n", i * 7); failed++; }
+    }
+    for (int i = 0; i < N; i++) {
+        if (idset_add(&s, 1, fid((ULONGLONG)i * 7, 0))) { wprintf(L"[FAIL] spilled id %d reported as new\n", i * 7); failed++; }
+    }
+    // ids between the spilled ones must not be mistaken for them
+    for (int i = 0; i < N; i++) {
+        if (!idset_add(&s, 1, fid((ULONGLONG)i * 7 + 3, 0))) { wprintf(L"[FAIL] id %d reported as seen\n", i * 7 + 3); failed++; }
+    }
+    // nor ids that differ from them only in the high half
+    for (int i = 0; i < N; i++) {
+        if (!idset_add(&s, 1, fid((ULONGLONG)i * 7, 1))) { wprintf(L"[FAIL] id %d:1 reported as seen\n", i * 7); failed++; }
+    }
+    for (int i = 0; i < N; i += 97) {
+        if (idset_add(&s, 1, fid((ULONGLONG)i * 7, 1))) { wprintf(L"[FAIL] spilled id %d:1 reported as new\n", i * 7); failed++; }
+    }
+
+    if (s.runCount < 1 || s.runCount > IDSET_MAX_RUNS) {
+        wprintf(L"[FAIL] Expected 1..%d runs, got %d\n", IDSET_MAX_RUNS, s.runCount);
+        failed++;
+    }
+    if (idset_count(&s) != (size_t)N * 3) {
+        wprintf(L"[FAIL] Expected %d entries, got %zu\n", N * 3, idset_count(&s));
+        failed++;
+    }
+    // merged runs must not leave their inputs' space behind
+    for (int r = 0; r < s.runCount; r++) {
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(s.runs[r].file, &sz) || (size_t)sz.QuadPart != s.runs[r].count * sizeof(IdDiskKey)) {
+            wprintf(L"[FAIL] Run %d: file holds %lld bytes for %zu keys\n", r, sz.QuadPart, s.runs[r].count);
+            failed++;
+        }
+    }
+
+    idset_destroy(&s);
+
+    if (!failed) wprintf(L"[PASS] Spilling IdSet test passed.\n");
+    return failed;
+}
+
+/* ---------------- Multithreaded test ---------------- */
+typedef struct {
+    IdSet* s;
+    int start;
+    int end;
+    volatile LONG* added;
+} IdSetThreadArg;
+
+static DWORD WINAPI idset_adder(LPVOID param) {
+    IdSetThreadArg* a = (IdSetThreadArg*)param;
+    for (int i = a->start; i < a->end; i++) {
+        if (idset_add(a->s, 7, fid((ULONGLONG)i, 0))) InterlockedIncrement(a->added);
+    }
+    return 0;
+}
+
+int test_idset_mt(void) {
+    wprintf(L"=== Multithreaded IdSet Test ===\n");
+
+    IdSet s;
+    if (!idset_init(&s)) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+
+    volatile LONG added = 0;
+    HANDLE threads[NUM_ID_THREADS];
+    IdSetThreadArg args[NUM_ID_THREADS];
+
+    // Ranges overlap by half, so every id is offered by two threads
+    for (int i = 0; i < NUM_ID_THREADS; i++) {
+        args[i].s = &s;
+        args[i].start = i * 10000;
+        args[i].end = i * 10000 + 20000;
+        args[i].added = &added;
+        threads[i] = CreateThread(NULL, 0, idset_adder, &args[i], 0, NULL);
+    }
+
+    WaitForMultipleObjects(NUM_ID_THREADS, threads, TRUE, INFINITE);
+    for (int i = 0; i < NUM_ID_THREADS; i++) CloseHandle(threads[i]);
+
+    LONG expected = (NUM_ID_THREADS + 1) * 10000;
+    int failed = 0;
+    if (added != expected || idset_count(&s) != (size_t)expected) {
+        wprintf(L"[FAIL] Expected %ld unique ids, added=%ld count=%zu\n", expected, added, idset_count(&s));
+        failed++;
+    }
+
+    idset_destroy(&s);
+
+    if (!failed) wprintf(L"[PASS] Multithreaded IdSet test passed.\n");
+    return failed;
+}
@@ -0,0 +1,12 @@
+#ifndef TEST_ID_SET_H
+#define TEST_ID_SET_H
+
+#include "../Utils/id_set.h"
+
+#define NUM_ID_THREADS 8
+
+int test_idset_st(void);
+int test_idset_mt(void);
+int test_idset_spill(void);
+
+#endif // TEST_ID_SET_H
@@ -7,6 +7,10 @@
 #include <string.h>
 #include "test_utils.h"
 #include "test_queue.h"
+#include "test_id_set.h"
+#include "test_disk_usage.h"
+#include "test_tree_diff.h"
+#include "test_archive.h"
 
 typedef int (*TestFunc)(void);
 
@@ -21,8 +25,22 @@ TestEntry tests[] = {
     {"ieq", test_ieq},
     {"match_glob", test_match_glob},
     {"contains_dir_segment", test_contains_dir_segment},
+    {"path_concat", test_path_concat},
+    {"rule_profile", test_rule_profile},
+    {"explain_path", test_explain_path},
     {"queue_st", test_queue_st},
-    {"queue_mt", test_queue_mt}
+    {"queue_mt", test_queue_mt},
+    {"queue_lifo", test_queue_lifo},
+    {"queue_spill", test_queue_spill},
+    {"idset_st", test_idset_st},
+    {"idset_mt", test_idset_mt},
+    {"idset_spill", test_idset_spill},
+    {"du_rollup", test_du_rollup},
+    {"diff_merge", test_diff_merge},
+    {"index_round_trip", test_index_round_trip},
+    {"diff_links", test_diff_links},
+    {"archive_zip", test_archive_zip},
+    {"archive_tar", test_archive_tar}
 };
 
 int main(int argc, char** argv) {
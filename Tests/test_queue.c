@@ -1,19 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "test_queue.h"
 
 int test_queue_st(void) {
     wprintf(L"=== Single-threaded Queue Test ===\n");
 
-    DirQueue q;
-    q.items = malloc(sizeof(wchar_t[QUEUE_CAP][MAX_PATH_LEN]));
-    if (!q.items) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+    DirQueue q = {0};
+    if (!q_init(&q)) { fwprintf(stderr, L"Heap allocation failed\n"); q_destroy(&q); return 1; }
 
-    InitializeCriticalSection(&q.cs);
-    q.head = q.tail = 0;
-    q.slotsSem = CreateSemaphore(NULL, QUEUE_CAP, QUEUE_CAP, NULL);
-    q.itemsSem = CreateSemaphore(NULL, 0, QUEUE_CAP, NULL);
-
-    wchar_t shutdownFlag = 0;
+    volatile LONG shutdownFlag = 0;
     const int N = 100;
     int failed = 0;
 
@@ -27,7 +23,7 @@ int test_queue_st(void) {
     // Pop items
     for (int i = 0; i < N; i++) {
         wchar_t out[MAX_PATH_LEN];
-        if (!q_pop(&q, out, (volatile LONG*)&shutdownFlag)) { failed++; break; }
+        if (!q_pop(&q, out, &shutdownFlag)) { failed++; break; }
         wchar_t expected[MAX_PATH_LEN];
         swprintf(expected, MAX_PATH_LEN, L"item-%d", i);
         if (wcscmp(out, expected) != 0) {
@@ -36,15 +32,147 @@ int test_queue_st(void) {
         }
     }
 
-    CloseHandle(q.slotsSem);
-    CloseHandle(q.itemsSem);
-    DeleteCriticalSection(&q.cs);
-    free(q.items);
+    q_destroy(&q);
 
     if (!failed) wprintf(L"[PASS] Single-threaded queue test passed.\n");
     return failed;
 }
 
+int test_queue_lifo(void) {
+    wprintf(L"=== LIFO Queue Test ===\n");
+
+    DirQueue q = {0};
+    if (!q_init(&q)) { fwprintf(stderr, L"Heap allocation failed\n"); q_destroy(&q); return 1; }
+    q.lifo = 1;
+
+    volatile LONG shutdownFlag = 0;
+    const int N = 100;
+    int failed = 0;
+
+    for (int i = 0; i < N; i++) {
+        DirItem item;
+        swprintf(item.path, MAX_PATH_LEN, L"item-%d", i);
+        item.depth = i;
+        item.kind = 0;
+        item.ctx = NULL;
+        if (!q_push_item(&q, &item)) failed++;
+    }
+
+    // Newest first, depth travels with the path
+    for (int i = N - 1; i >= 0; i--) {
+        DirItem out;
+        if (!q_pop_item(&q, &out, &shutdownFlag)) { failed++; break; }
+        wchar_t expected[MAX_PATH_LEN];
+        swprintf(expected, MAX_PATH_LEN, L"item-%d", i);
+        if (wcscmp(out.path, expected) != 0 || out.depth != i) {
+            wprintf(L"[FAIL] Expected '%s' (depth %d), got '%s' (depth %d)\n", expected, i, out.path, out.depth);
+            failed++;
+        }
+    }
+
+    q_destroy(&q);
+
+    if (!failed) wprintf(L"[PASS] LIFO queue test passed.\n");
+    return failed;
+}
+
+int test_queue_spill(void) {
+    wprintf(L"=== Spilling Queue Test ===\n");
+
+    const int N = 5000;
+    int failed = 0;
+    int* seen = calloc(N, sizeof(int));
+    if (!seen) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+
+    for (int lifo = 0; lifo < 2; lifo++) {
+        DirQueue q = {0};
+        if (!q_init(&q)) { fwprintf(stderr, L"Heap allocation failed\n"); q_destroy(&q); free(seen); return 1; }
+        q.lifo = lifo;
+        if (!q_enable_spill(&q, 16, NULL)) { wprintf(L"[FAIL] q_enable_spill\n"); q_destroy(&q); failed++; continue; }
+
+        volatile LONG shutdownFlag = 0;
+        memset(seen, 0, N * sizeof(int));
+
+        // Far more items than the 16-slot budget; pushes must never block, and FIFO must
+        // still come out in push order
+        int popped = 0, next = 0;
+        for (int i = 0; i < N; i++) {
+            DirItem item;
+            swprintf(item.path, MAX_PATH_LEN, L"item-%d", i);
+            item.depth = i % 100;
+            item.kind = i % 3;
+            item.ctx = &seen[i];
+            if (!q_push_item(&q, &item)) { failed++; break; }
+            if (i % 3 == 0) {
+                DirItem out;
+                if (!q_pop_item(&q, &out, &shutdownFlag)) { failed++; break; }
+                int v = _wtoi(out.path + 5);
+                if (v >= 0 && v < N && out.depth == v % 100 && out.kind == v % 3 && out.ctx == &seen[v]) seen[v]++; else failed++;
+                if (!lifo && v != next++) { wprintf(L"[FAIL] FIFO popped item-%d, expected item-%d\n", v, next - 1); failed++; }
+                popped++;
+            }
+        }
+        for (; popped < N; popped++) {
+            DirItem out;
+            if (!q_pop_item(&q, &out, &shutdownFlag)) { failed++; break; }
+            int v = _wtoi(out.path + 5);
+            if (v >= 0 && v < N && out.depth == v % 100 && out.kind == v % 3 && out.ctx == &seen[v]) seen[v]++; else failed++;
+            if (!lifo && v != next++) { wprintf(L"[FAIL] FIFO popped item-%d, expected item-%d\n", v, next - 1); failed++; }
+        }
+        for (int i = 0; i < N; i++) {
+            if (seen[i] != 1) { wprintf(L"[FAIL] lifo=%d: item-%d popped %d times\n", lifo, i, seen[i]); failed++; }
+        }
+
+        q_destroy(&q);
+    }
+    free(seen);
+
+    // Spill space follows the pending items, not everything ever spilled
+    for (int lifo = 0; lifo < 2; lifo++) {
+        DirQueue q = {0};
+        if (!q_init(&q)) { fwprintf(stderr, L"Heap allocation failed\n"); q_destroy(&q); return failed + 1; }
+        q.lifo = lifo;
+        if (!q_enable_spill(&q, 16, NULL)) { wprintf(L"[FAIL] q_enable_spill\n"); q_destroy(&q); failed++; continue; }
+        q.spillFileMax = 4096;
+
+        volatile LONG shutdownFlag = 0;
+        ULONGLONG peak = 0;
+        HANDLE first = q.spill;
+        int next = 0, last = -1, stop = 0;
+        // 1000 items stay pending while bursts of 200 come and go
+        for (int i = 0; i < N && !stop; ) {
+            int burst = i ? 200 : 1000;
+            for (int k = 0; k < burst; k++, i++) {
+                DirItem item = {0};
+                swprintf(item.path, MAX_PATH_LEN, L"item-%d", i);
+                if (!q_push_item(&q, &item)) { failed++; stop = 1; break; }
+            }
+            if (i == 1000) continue;
+            for (int k = 0; k < burst; k++) {
+                DirItem out;
+                if (!q_pop_item(&q, &out, &shutdownFlag)) { failed++; stop = 1; break; }
+                int v = _wtoi(out.path + 5);
+                if (!lifo && v != next++) { wprintf(L"[FAIL] FIFO popped item-%d, expected item-%d\n", v, next - 1); failed++; }
+                last = v;
+            }
+            if (i > N / 2 && q.spillEnd > peak) peak = q.spillEnd;
+        }
+        // A batch holds at most 8 short records past the limit
+        if (!lifo && (q.spill == first || peak > q.spillFileMax + 8 * 64)) {
+            wprintf(L"[FAIL] FIFO spill file not rotated: end %llu, limit %llu\n", peak, q.spillFileMax);
+            failed++;
+        }
+        if (lifo && peak > 1000 * 64) {
+            wprintf(L"[FAIL] LIFO spill file kept growing: end %llu after item-%d\n", peak, last);
+            failed++;
+        }
+        q_destroy(&q);
+    }
+
+    if (!failed) wprintf(L"[PASS] Spilling queue test passed.\n");
+    return failed;
+}
+
 /* ---------------- Multithreaded test ---------------- */
 typedef struct {
     DirQueue* q;
@@ -75,14 +203,8 @@ DWORD WINAPI consumer(LPVOID param) {
 int test_queue_mt(void) {
     wprintf(L"=== Multithreaded Queue Test ===\n");
 
-    DirQueue q;
-    q.items = malloc(sizeof(wchar_t[QUEUE_CAP][MAX_PATH_LEN]));
-    if (!q.items) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
-
-    InitializeCriticalSection(&q.cs);
-    q.head = q.tail = 0;
-    q.slotsSem = CreateSemaphore(NULL, QUEUE_CAP, QUEUE_CAP, NULL);
-    q.itemsSem = CreateSemaphore(NULL, 0, QUEUE_CAP, NULL);
+    DirQueue q = {0};
+    if (!q_init(&q)) { fwprintf(stderr, L"Heap allocation failed\n"); q_destroy(&q); return 1; }
 
     volatile LONG shutdownFlag = 0;
     HANDLE producers[2], consumers[2];
@@ -115,10 +237,7 @@ int test_queue_mt(void) {
 
     WaitForMultipleObjects(2, consumers, TRUE, INFINITE);
 
-    CloseHandle(q.slotsSem);
-    CloseHandle(q.itemsSem);
-    DeleteCriticalSection(&q.cs);
-    free(q.items);
+    q_destroy(&q);
 
     wprintf(L"[PASS] Multithreaded queue test completed.\n");
     return 0;
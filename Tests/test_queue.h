@@ -7,5 +7,7 @@
 
 int test_queue_st();
 int test_queue_mt();
+int test_queue_lifo(void);
+int test_queue_spill(void);
 
 #endif // TEST_QUEUE_H
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+#include "test_tree_diff.h"
+#include "../Utils/utils.h"
+
+#define MAX_RECORDS 16
+
+#ifndef SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE
+#define SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE 0x2
+#endif
+
+static void temp_path(wchar_t* out, const wchar_t* name) {
+    wchar_t dir[MAX_PATH];
+    GetTempPathW(MAX_PATH, dir);
+    path_concat(out, MAX_PATH, dir, name);
+}
+
+static void add_hashed(DiffList* l, const wchar_t* name, ULONGLONG size, ULONGLONG mtime, ULONGLONG hash) {
+    list_add(l, name, 0, size, mtime);
+    l->items[l->count - 1].hash = hash;
+}
+
+// Reads back the records a TreeDiff wrote to its out stream
+static int read_records(FILE* f, wchar_t recs[][MAX_PATH]) {
+    int n = 0;
+    rewind(f);
+    while (n < MAX_RECORDS && fgetws(recs[n], MAX_PATH, f)) {
+        size_t len = wcslen(recs[n]);
+        while (len > 0 && (recs[n][len-1] == L'\n' || recs[n][len-1] == L'\r')) recs[n][--len] = 0;
+        n++;
+    }
+    return n;
+}
+
+static int check_records(wchar_t recs[][MAX_PATH], int count, const wchar_t** expected, int total) {
+    int failed = 0;
+    for (int i = 0; i < total; i++) {
+        int found = 0;
+        for (int k = 0; k < count; k++) if (!wcscmp(recs[k], expected[i])) found = 1;
+        if (!found) {
+            wprintf(L"[FAIL] Case %d: missing record '%s'\n", i, expected[i]);
+            failed++;
+        } else {
+            wprintf(L"[PASS] Case %d\n", i);
+        }
+    }
+    if (count != total) {
+        wprintf(L"[FAIL] Expected %d records, got %d\n", total, count);
+        for (int k = 0; k < count; k++) wprintf(L"       %s\n", recs[k]);
+        failed++;
+    }
+    return failed;
+}
+
+int test_diff_merge(void) {
+    wprintf(L"=== Tests for diff_dir A/R/M merge ===\n");
+
+    wchar_t idx[MAX_PATH];
+    temp_path(idx, L"filterfilesmt_merge.idx");
+
+    // Baseline: an index written by a plain --write-index run
+    TreeDiff w;
+    diff_init(&w, L"C:\\t", NULL, 0, 0);
+    if (!diff_set_index_out(&w, idx)) { diff_finish(&w); return 1; }
+    DiffList l = {0};
+    list_add(&l, L"same.txt", 0, 10, 100);
+    list_add(&l, L"grown.txt", 0, 5, 100);
+    list_add(&l, L"touched.txt", 0, 5, 100);
+    list_add(&l, L"gone.txt", 0, 1, 100);
+    list_add(&l, L"flip", 0, 1, 100);
+    list_add(&l, L"sub", 1, 0, 0);
+    diff_dir(&w, L"C:\\t", L"", &l); list_clear(&l);
+    list_add(&l, L"kept.txt", 0, 1, 100);
+    diff_dir(&w, L"C:\\t\\sub", L"sub", &l); list_clear(&l);
+    list_add(&l, L"y.txt", 0, 1, 100);
+    diff_dir(&w, L"C:\\t\\old", L"old", &l); list_clear(&l);
+    diff_finish(&w);
+
+    TreeDiff d;
+    diff_init(&d, L"C:\\t", NULL, 0, 0);
+    if (!diff_set_baseline(&d, idx)) { diff_finish(&d); DeleteFileW(idx); return 1; }
+    d.out = tmpfile();
+    if (!d.out) { fwprintf(stderr, L"tmpfile failed\n"); diff_finish(&d); DeleteFileW(idx); return 1; }
+    list_add(&l, L"Same.txt", 0, 10, 100);   // names compare case-insensitively
+    list_add(&l, L"grown.txt", 0, 6, 100);
+    list_add(&l, L"touched.txt", 0, 5, 200);
+    list_add(&l, L"new.txt", 0, 1, 100);
+    list_add(&l, L"flip", 1, 0, 0);          // file replaced by a directory
+    list_add(&l, L"sub", 1, 0, 0);
+    diff_dir(&d, L"C:\\t", L"", &l); list_clear(&l);
+    list_add(&l, L"kept.txt", 0, 1, 100);
+    diff_dir(&d, L"C:\\t\\sub", L"sub", &l); list_free(&l);
+    FILE* out = d.out;
+    diff_finish(&d); // "old" was never reached
+
+    const wchar_t* expected[] = {
+        L"A|C:\\t\\new.txt",
+        L"M|C:\\t\\grown.txt",
+        L"M|C:\\t\\touched.txt",
+        L"R|C:\\t\\gone.txt",
+        L"R|C:\\t\\flip",
+        L"R|C:\\t\\old\\y.txt",
+    };
+    int total = sizeof(expected) / sizeof(*expected);
+    wchar_t recs[MAX_RECORDS][MAX_PATH];
+    int count = read_records(out, recs);
+    fclose(out);
+    DeleteFileW(idx);
+
+    int failed = check_records(recs, count, expected, total);
+    wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
+    return failed;
+}
+
+int test_index_round_trip(void) {
+    wprintf(L"=== Tests for index write/read round trip ===\n");
+
+    wchar_t idx[MAX_PATH], idx2[MAX_PATH];
+    temp_path(idx, L"filterfilesmt_trip.idx");
+    temp_path(idx2, L"filterfilesmt_trip2.idx");
+
+    TreeDiff w;
+    diff_init(&w, L"C:\\t", NULL, 0, 1);
+    if (!diff_set_index_out(&w, idx)) { diff_finish(&w); return 1; }
+    DiffList l = {0};
+    add_hashed(&l, L"caf\u00e9 menu.txt", 0xFFFFFFFFFFFFFFFFULL, 132000000000000000ULL, 0x0123456789ABCDEFULL);
+    add_hashed(&l, L"a.b.c", 0, 1, 42);
+    list_add(&l, L"plain.txt", 0, 7, 132000000000000001ULL); // no hash: compared on mtime
+    list_add(&l, L"a", 1, 0, 0);
+    list_add(&l, L"ab", 1, 0, 0);
+    diff_dir(&w, L"C:\\t", L"", &l); list_clear(&l);
+    add_hashed(&l, L"f.txt", 1, 100, 1);
+    diff_dir(&w, L"C:\\t\\a", L"a", &l); list_clear(&l);
+    add_hashed(&l, L"deep.txt", 3, 300, 7);
+    diff_dir(&w, L"C:\\t\\a\\b", L"a/b", &l); list_clear(&l);
+    add_hashed(&l, L"f.txt", 1, 100, 1);
+    diff_dir(&w, L"C:\\t\\ab", L"ab", &l); list_clear(&l);
+    diff_finish(&w);
+
+    // Same tree again, except that "a" cannot be listed and "ab/f.txt" has new content
+    TreeDiff d;
+    diff_init(&d, L"C:\\t", NULL, 0, 1);
+    if (!diff_set_baseline(&d, idx) || !diff_set_index_out(&d, idx2)) { diff_finish(&d); DeleteFileW(idx); return 1; }
+    d.out = tmpfile();
+    if (!d.out) { fwprintf(stderr, L"tmpfile failed\n"); diff_finish(&d); DeleteFileW(idx); DeleteFileW(idx2); return 1; }
+    add_hashed(&l, L"caf\u00e9 menu.txt", 0xFFFFFFFFFFFFFFFFULL, 132000000000000000ULL, 0x0123456789ABCDEFULL);
+    add_hashed(&l, L"a.b.c", 0, 1, 42);
+    list_add(&l, L"plain.txt", 0, 7, 132000000000000001ULL);
+    list_add(&l, L"a", 1, 0, 0);
+    list_add(&l, L"ab", 1, 0, 0);
+    diff_dir(&d, L"C:\\t", L"", &l); list_clear(&l);
+    diff_keep_dir(&d, L"a");
+    add_hashed(&l, L"f.txt", 1, 100, 2);
+    diff_dir(&d, L"C:\\t\\ab", L"ab", &l); list_free(&l);
+    FILE* out = d.out;
+    diff_finish(&d);
+
+    const wchar_t* expected[] = { L"M|C:\\t\\ab\\f.txt" };
+    int total = sizeof(expected) / sizeof(*expected);
+    wchar_t recs[MAX_RECORDS][MAX_PATH];
+    int count = read_records(out, recs);
+    fclose(out);
+    int failed = check_records(recs, count, expected, total);
+
+    // The kept blocks are carried over to the new index as they were
+    const char* keptLines[] = { "D|a\n", "F|f.txt|1|100|1\n", "D|a/b\n", "F|deep.txt|3|300|7\n", "F|f.txt|1|100|2\n" };
+    int keptTotal = sizeof(keptLines) / sizeof(*keptLines);
+    int found[8] = {0};
+    FILE* f = NULL;
+    if (_wfopen_s(&f, idx2, L"rb") == 0 && f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            for (int i = 0; i < keptTotal; i++) if (!strcmp(line, keptLines[i])) found[i] = 1;
+        }
+        fclose(f);
+    }
+    for (int i = 0; i < keptTotal; i++) {
+        if (!found[i]) { wprintf(L"[FAIL] New index lacks line %d\n", i); failed++; }
+    }
+    total += keptTotal;
+
+    DeleteFileW(idx);
+    DeleteFileW(idx2);
+    wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
+    return failed;
+}
+
+static void remove_link_tree(const wchar_t* base, const wchar_t* real, const wchar_t* file, const wchar_t* link, const wchar_t* up) {
+    RemoveDirectoryW(up);   // directory links go like empty directories
+    RemoveDirectoryW(link);
+    DeleteFileW(file);
+    RemoveDirectoryW(real);
+    RemoveDirectoryW(base);
+}
+
+// A baseline root holding a link to one of its directories and, inside that, a link back up
+int test_diff_links(void) {
+    wprintf(L"=== Tests for links in a baseline root ===\n");
+
+    wchar_t tmp[MAX_PATH], base[MAX_PATH], real[MAX_PATH], file[MAX_PATH], link[MAX_PATH], up[MAX_PATH];
+    GetTempPathW(MAX_PATH, tmp);
+    path_concat(base, MAX_PATH, tmp, L"filterfilesmt_links");
+    path_concat(real, MAX_PATH, base, L"real");
+    path_concat(file, MAX_PATH, real, L"f.txt");
+    path_concat(link, MAX_PATH, base, L"link");
+    path_concat(up, MAX_PATH, real, L"up");
+    remove_link_tree(base, real, file, link, up);
+
+    FILE* f = NULL;
+    DWORD flags = SYMBOLIC_LINK_FLAG_DIRECTORY | SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE;
+    if (!CreateDirectoryW(base, NULL) || !CreateDirectoryW(real, NULL) || _wfopen_s(&f, file, L"wb") != 0 || !f) {
+        fwprintf(stderr, L"Failed to create %s\n", base);
+        remove_link_tree(base, real, file, link, up);
+        return 1;
+    }
+    fclose(f);
+    if (!CreateSymbolicLinkW(link, real, flags) || !CreateSymbolicLinkW(up, base, flags)) {
+        wprintf(L"[SKIP] Cannot create symbolic links here (needs Developer Mode or admin rights)\n");
+        remove_link_tree(base, real, file, link, up);
+        return 0;
+    }
+
+    // The current side has "real" only; links are skipped unless followed, and a followed
+    // link is walked once, without going round the loop
+    const wchar_t* followed[] = { L"R|C:\\t\\link\\f.txt" };
+    int failed = 0, total = 0;
+    for (int follow = 0; follow < 2; follow++) {
+        TreeDiff d;
+        diff_init(&d, L"C:\\t", NULL, 0, 0);
+        d.follow = follow;
+        if (!diff_set_baseline(&d, base)) { diff_finish(&d); failed++; break; }
+        d.out = tmpfile();
+        if (!d.out) { fwprintf(stderr, L"tmpfile failed\n"); diff_finish(&d); failed++; break; }
+        DiffList l = {0};
+        list_add(&l, L"real", 1, 0, 0);
+        diff_dir(&d, L"C:\\t", L"", &l);
+        list_free(&l);
+        FILE* out = d.out;
+        diff_finish(&d);
+
+        wchar_t recs[MAX_RECORDS][MAX_PATH];
+        int count = read_records(out, recs);
+        fclose(out);
+        wprintf(L"follow=%d:\n", follow);
+        failed += check_records(recs, count, followed, follow ? 1 : 0);
+        total += follow ? 2 : 1;
+    }
+
+    remove_link_tree(base, real, file, link, up);
+    wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
+    return failed;
+}
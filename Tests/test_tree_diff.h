@@ -0,0 +1,10 @@
+#ifndef TEST_TREE_DIFF_H
+#define TEST_TREE_DIFF_H
+
+#include "../tree_diff.h"
+
+int test_diff_merge(void);
+int test_index_round_trip(void);
+int test_diff_links(void);
+
+#endif // TEST_TREE_DIFF_H
@@ -3,6 +3,7 @@
 #include <string.h>
 #include "../Utils/utils.h"
 #include "../Utils/path_queue.h"
+#include "../pattern_matching.h"
 
 int test_trim_ws(void) {
     wprintf(L"=== Tests for trim_ws ===\n");
@@ -168,6 +169,121 @@ int test_contains_dir_segment(void) {
         }
     }
 
+    wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
+    return failed;
+}
+
+int test_path_concat(void) {
+    wprintf(L"=== Tests for path_concat ===\n");
+
+    struct { 
+        const wchar_t* base; 
+        const wchar_t* name; 
+        const wchar_t* expected; 
+    } tests[] = {
+        {L"C:\\root", L"file.txt", L"C:\\root\\file.txt"},
+        {L"C:\\root\\", L"file.txt", L"C:\\root\\file.txt"},
+        {L"C:/root/", L"sub", L"C:/root/sub"},
+        {L"C:\\root\\", L"", L"C:\\root\\"},
+        {L"", L"file.txt", L"file.txt"},
+    };
+
+    int failed = 0;
+    int total = sizeof(tests) / sizeof(*tests);
+
+    for (int i=0; i<total; i++) {
+        wchar_t out[MAX_PATH_LEN];
+        path_concat(out, MAX_PATH_LEN, tests[i].base, tests[i].name);
+        if (wcscmp(out, tests[i].expected) != 0) {
+            wprintf(L"[FAIL] Case %d: base='%s', name='%s', expected='%s', got='%s'\n",
+                    i, tests[i].base, tests[i].name, tests[i].expected, out);
+            failed++;
+        } else {
+            wprintf(L"[PASS] Case %d\n", i);
+        }
+    }
+
+    wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
+    return failed;
+}
+
+static void set_rule(Pattern* p, const wchar_t* text, int neg, int anchored, int dirOnly, int line) {
+    wcscpy_s(p->text, MAX_PATH_LEN, text);
+    p->neg = neg; p->anchored = anchored; p->dirOnly = dirOnly; p->line = line;
+}
+
+int test_rule_profile(void) {
+    wprintf(L"=== Tests for is_ignored_profiled ===\n");
+
+    Pattern pats[4];
+    set_rule(&pats[0], L"*.log", 0, 0, 0, 1);
+    set_rule(&pats[1], L"keep.log", 1, 0, 0, 2);
+    set_rule(&pats[2], L"never", 0, 0, 0, 3);
+    set_rule(&pats[3], L"*a*a*a*a*b", 0, 0, 0, 4);
+
+    const wchar_t* paths[] = { L"x/a.log", L"x/keep.log", L"x/y.txt", L"aaaaaaaaaaaaaaaaaaaa" };
+    int expected[] = { 1, 0, 0, 0 };
+
+    RuleProfile prof;
+    if (!profile_init(&prof, 4)) { fwprintf(stderr, L"Heap allocation failed\n"); return 1; }
+
+    int failed = 0;
+    for (int i = 0; i < 4; i++) {
+        int got = is_ignored_profiled(paths[i], 0, pats, 4, &prof);
+        if (got != expected[i] || got != is_ignored(paths[i], 0, pats, 4)) {
+            wprintf(L"[FAIL] '%s': expected %d, got %d\n", paths[i], expected[i], got);
+            failed++;
+        }
+    }
+
+    PatternStats* st = prof.stats;
+    if (prof.tested != 4 || st[0].evaluated != 4 || st[2].evaluated != 4) { wprintf(L"[FAIL] evaluation counts\n"); failed++; }
+    if (st[0].matched != 2 || st[0].overridden != 1) {
+        wprintf(L"[FAIL] *.log: matched=%llu overridden=%llu, expected 2/1\n", st[0].matched, st[0].overridden);
+        failed++;
+    }
+    if (st[1].matched != 1 || st[1].overridden != 0) { wprintf(L"[FAIL] !keep.log counts\n"); failed++; }
+    if (st[2].matched != 0) { wprintf(L"[FAIL] dead rule matched\n"); failed++; }
+    // literal rules stay linear; stacked '*' on a long run of 'a' does not
+    if (st[0].slow || st[1].slow || st[2].slow) { wprintf(L"[FAIL] linear rule flagged as backtracking\n"); failed++; }
+    if (!st[3].slow) { wprintf(L"[FAIL] backtracking rule not flagged (calls=%llu)\n", st[3].calls); failed++; }
+
+    profile_free(&prof);
+
+    if (!failed) wprintf(L"[PASS] Rule profile test passed.\n");
+    return failed;
+}
+
+int test_explain_path(void) {
+    wprintf(L"=== Tests for explain_path ===\n");
+
+    Pattern pats[3];
+    set_rule(&pats[0], L"build", 0, 0, 1, 1);
+    set_rule(&pats[1], L"*.o", 0, 0, 0, 2);
+    set_rule(&pats[2], L"keep.o", 1, 0, 0, 3);
+
+    struct { const wchar_t* rel; int isDir; int expected; } tests[] = {
+        {L"src/a.o", 0, 1},
+        {L"src/keep.o", 0, 0},
+        {L"build/keep.o", 0, 1},   // a negation cannot reach into an excluded directory
+        {L"build", 1, 1},
+        {L"build", 0, 0},          // dir-only rule
+        {L"src/a.c", 0, 0},
+    };
+
+    int failed = 0;
+    int total = sizeof(tests) / sizeof(*tests);
+
+    for (int i = 0; i < total; i++) {
+        int got = explain_path(tests[i].rel, tests[i].isDir, pats, 3);
+        if (got != tests[i].expected) {
+            wprintf(L"[FAIL] Case %d: '%s' expected %d, got %d\n", i, tests[i].rel, tests[i].expected, got);
+            failed++;
+        } else {
+            wprintf(L"[PASS] Case %d\n", i);
+        }
+    }
+
     wprintf(L"%d/%d test cases passed.\n", (total-failed), total);
     return failed;
 }
\ No newline at end of file
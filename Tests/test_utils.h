@@ -6,5 +6,8 @@ int test_to_forward_slashes(void);
 int test_ieq(void);
 int test_match_glob(void);
 int test_contains_dir_segment(void);
+int test_path_concat(void);
+int test_rule_profile(void);
+int test_explain_path(void);
 
 #endif // TEST_UTILS_H
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "archive_enum.h"
+#include "utils.h"
+
+#define ZIP_EOCD_SIG     0x06054b50
+#define ZIP64_LOC_SIG    0x07064b50
+#define ZIP64_EOCD_SIG   0x06064b50
+#define ZIP_CDIR_SIG     0x02014b50
+#define ZIP_EOCD_LEN     22
+#define ZIP_CDIR_LEN     46
+#define ZIP_BUF          (256*1024) // > one central directory record (46 + 3 * 64K)
+#define TAR_BLOCK        512
+#define CP_DOS           437   // zip names without the UTF-8 flag
+
+static WORD rd16(const BYTE* p){ return (WORD)(p[0]|p[1]<<8); }
+static DWORD rd32(const BYTE* p){ return (DWORD)p[0]|(DWORD)p[1]<<8|(DWORD)p[2]<<16|(DWORD)p[3]<<24; }
+static ULONGLONG rd64(const BYTE* p){ return (ULONGLONG)rd32(p)|(ULONGLONG)rd32(p+4)<<32; }
+
+int archive_kind(const wchar_t* name){
+    size_t n=wcslen(name);
+    if(n>4 && !_wcsicmp(name+n-4,L".zip")) return ARCHIVE_ZIP;
+    if(n>4 && !_wcsicmp(name+n-4,L".tar")) return ARCHIVE_TAR;
+    return ARCHIVE_NONE;
+}
+
+// Converts a raw member name; rejects empty names and names that climb out with "..".
+static int set_name(ArchiveEnum* e,const char* raw,int len,UINT cp){
+    int n=MultiByteToWideChar(cp,0,raw,len,e->name,MAX_PATH_LEN-1);
+    if(n<=0) return 0;
+    e->name[n]=0;
+    for(wchar_t* s=e->name;*s;s++) if(*s==L'\\') *s=L'/';
+    e->isDir=0;
+    while(n>0 && e->name[n-1]==L'/'){ e->name[--n]=0; e->isDir=1; }
+    wchar_t* s=e->name;
+    while(*s==L'/' || (s[0]==L'.' && s[1]==L'/')) s+= *s==L'/' ? 1 : 2;
+    if(s!=e->name) memmove(e->name,s,(wcslen(s)+1)*sizeof(wchar_t));
+    if(!e->name[0]) return 0;
+    for(const wchar_t* p=e->name;*p;){
+        const wchar_t* seg=p;
+        while(*p && *p!=L'/') p++;
+        if(p-seg==2 && seg[0]==L'.' && seg[1]==L'.') return 0;
+        if(*p) p++;
+    }
+    return 1;
+}
+
+/* -------- zip -------- */
+// Returns need bytes at file offset off, refilling the window from off when they are not in it
+static const BYTE* zip_at(ArchiveEnum* e,ULONGLONG off,DWORD need){
+    if(off>=e->bufOff && off+need<=e->bufOff+e->bufLen) return e->buf+(off-e->bufOff);
+    if(off>e->fileSize || need>e->fileSize-off) return NULL;
+    ULONGLONG len=e->fileSize-off;
+    if(len>ZIP_BUF) len=ZIP_BUF;
+    if(!file_read_at(e->file,off,e->buf,(DWORD)len)){ e->readError=1; e->bufLen=0; return NULL; }
+    e->bufOff=off; e->bufLen=(DWORD)len;
+    return e->buf;
+}
+
+static int zip_open(ArchiveEnum* e){
+    if(e->fileSize<ZIP_EOCD_LEN) return 0;
+    e->buf=malloc(ZIP_BUF);
+    if(!e->buf) return 0;
+
+    // The end record is last, followed by at most a 64K comment
+    ULONGLONG tail= e->fileSize>ZIP_EOCD_LEN+0xFFFF ? e->fileSize-ZIP_EOCD_LEN-0xFFFF : 0;
+    const BYTE* v=zip_at(e,tail,(DWORD)(e->fileSize-tail));
+    if(!v) return 0;
+    ULONGLONG p=e->fileSize-ZIP_EOCD_LEN-tail;
+    while(rd32(v+p)!=ZIP_EOCD_SIG){ if(p==0) return 0; p--; }
+    ULONGLONG eocd=tail+p;
+
+    ULONGLONG entries=rd16(v+p+10), cdSize=rd32(v+p+12), cdOff=rd32(v+p+16);
+    const BYTE* loc= eocd>=20 ? zip_at(e,eocd-20,20) : NULL;
+    if((entries==0xFFFF || cdSize==0xFFFFFFFF || cdOff==0xFFFFFFFF) && loc && rd32(loc)==ZIP64_LOC_SIG){
+        const BYTE* z=zip_at(e,rd64(loc+8),56);
+        if(z && rd32(z)==ZIP64_EOCD_SIG){
+            entries=rd64(z+32); cdSize=rd64(z+40); cdOff=rd64(z+48);
+        }
+    }
+    if(cdOff>e->fileSize || cdSize>e->fileSize-cdOff) return 0;
+    e->pos=cdOff; e->end=cdOff+cdSize; e->remaining=entries;
+    return 1;
+}
+
+static int zip_next(ArchiveEnum* e){
+    while(e->remaining && e->pos+ZIP_CDIR_LEN<=e->end){
+        const BYTE* h=zip_at(e,e->pos,ZIP_CDIR_LEN);
+        if(!h || rd32(h)!=ZIP_CDIR_SIG) return 0;
+        WORD nl=rd16(h+28), xl=rd16(h+30), cl=rd16(h+32);
+        if(e->pos+ZIP_CDIR_LEN+nl+xl+cl>e->end) return 0;
+        h=zip_at(e,e->pos,ZIP_CDIR_LEN+nl+xl+cl); // the whole record in one window
+        if(!h) return 0;
+        WORD flags=rd16(h+8), dtime=rd16(h+12), ddate=rd16(h+14);
+        ULONGLONG usize=rd32(h+24);
+        const BYTE* name=h+ZIP_CDIR_LEN;
+        const BYTE* extra=name+nl;
+        e->pos+=ZIP_CDIR_LEN+nl+xl+cl; e->remaining--;
+
+        if(usize==0xFFFFFFFF){ // real size is the first field of the zip64 extra block
+            for(const BYTE* x=extra;x+4<=extra+xl;x+=4+rd16(x+2)){
+                if(rd16(x)==0x0001 && rd16(x+2)>=8 && x+12<=extra+xl){ usize=rd64(x+4); break; }
+            }
+        }
+        if(!set_name(e,(const char*)name,nl,(flags & 0x0800) ? CP_UTF8 : CP_DOS)) continue;
+        FILETIME ft;
+        e->mtime= DosDateTimeToFileTime(ddate,dtime,&ft) ? ((ULONGLONG)ft.dwHighDateTime<<32)|ft.dwLowDateTime : 0;
+        e->size= e->isDir ? 0 : usize;
+        return 1;
+    }
+    return 0;
+}
+
+/* -------- tar -------- */
+static ULONGLONG tar_num(const BYTE* p,int len){
+    ULONGLONG v=0;
+    if(p[0] & 0x80){ // base-256 (GNU, sizes >= 8 GiB)
+        v=p[0] & 0x7F;
+        for(int i=1;i<len;i++) v=v<<8|p[i];
+        return v;
+    }
+    int i=0;
+    while(i<len && (p[i]==' '||p[i]==0)) i++;
+    for(;i<len && p[i]>='0' && p[i]<='7';i++) v=v*8+(p[i]-'0');
+    return v;
+}
+
+static int tar_checksum_ok(const BYTE* h){
+    ULONGLONG sum=0;
+    for(int i=0;i<TAR_BLOCK;i++) sum+= (i>=148 && i<156) ? ' ' : h[i];
+    return sum==tar_num(h+148,8);
+}
+
+// Pax extended header: records of the form "<len> path=<value>\n"
+static void pax_path(ArchiveEnum* e,char* data,size_t n){
+    size_t i=0;
+    while(i<n){
+        size_t len=0, j=i;
+        while(j<n && data[j]>='0' && data[j]<='9') len=len*10+(data[j++]-'0');
+        if(!len || i+len>n) return;
+        if(j<n && data[j]==' ' && i+len-j>6 && !strncmp(data+j+1,"path=",5)){
+            size_t vlen=i+len-(j+6)-1; // drop the trailing newline
+            if(vlen>=sizeof(e->longName)){ e->haveLong=-1; return; }
+            memcpy(e->longName,data+j+6,vlen); e->longName[vlen]=0;
+            e->haveLong=1;
+        }
+        i+=len;
+    }
+}
+
+// The first block must be a header, or the end-of-archive block of an empty archive
+static int tar_open(ArchiveEnum* e){
+    BYTE h[TAR_BLOCK];
+    if(e->fileSize<TAR_BLOCK || !file_read_at(e->file,0,h,TAR_BLOCK)) return 0;
+    if(h[0]) return tar_checksum_ok(h);
+    for(int i=1;i<TAR_BLOCK;i++) if(h[i]) return 0;
+    return 1;
+}
+
+static int tar_next(ArchiveEnum* e){
+    BYTE h[TAR_BLOCK];
+    for(;;){
+        if(e->off+TAR_BLOCK>e->fileSize) return 0;
+        if(!file_read_at(e->file,e->off,h,TAR_BLOCK)){ e->readError=1; return 0; }
+        if(!h[0] || !tar_checksum_ok(h)) return 0; // end-of-archive block, or not a tar
+        ULONGLONG size=tar_num(h+124,12);
+        ULONGLONG dataOff=e->off+TAR_BLOCK;
+        // A base-256 size can be anything; one past the end would wrap the offset around
+        if(size>e->fileSize-dataOff) return 0;
+        ULONGLONG next=dataOff+((size+TAR_BLOCK-1) & ~(ULONGLONG)(TAR_BLOCK-1));
+        if(next<=e->off) return 0;
+        e->off=next;
+        char type=(char)h[156];
+
+        if(type=='L' || type=='x'){ // the name of the next member
+            if(size>=0x100000){ e->haveLong=-1; continue; } // checked before allocating: a base-256 size can be huge
+            char* data=malloc((size_t)size+1);
+            if(!data){ e->haveLong=-1; continue; }
+            if(!file_read_at(e->file,dataOff,data,(DWORD)size)){ free(data); e->readError=1; return 0; }
+            data[size]=0;
+            if(type=='L'){
+                size_t n=strlen(data);
+                if(n<sizeof(e->longName)){ memcpy(e->longName,data,n+1); e->haveLong=1; } else e->haveLong=-1;
+            } else pax_path(e,data,(size_t)size);
+            free(data);
+            continue;
+        }
+        if(type=='g' || type=='K') continue;
+
+        int haveLong=e->haveLong; e->haveLong=0;
+        if(type!='5' && type!='0' && type!='\0' && type!='7') continue; // links, devices, fifos
+        if(haveLong<0) continue;
+
+        char name[TAR_BLOCK]; int n=0;
+        if(haveLong){
+            if(!set_name(e,e->longName,(int)strlen(e->longName),CP_UTF8)) continue;
+        } else {
+            if(!memcmp(h+257,"ustar\0",6) && h[345]){ // POSIX prefix/name split; old GNU headers keep times there
+                int pl=(int)strnlen((const char*)h+345,155);
+                memcpy(name,h+345,pl); n=pl; name[n++]='/';
+            }
+            int nl=(int)strnlen((const char*)h,100);
+            memcpy(name+n,h,nl); n+=nl;
+            if(!set_name(e,name,n,CP_UTF8)) continue;
+        }
+        if(type=='5') e->isDir=1;
+        e->size= e->isDir ? 0 : size;
+        ULONGLONG t=tar_num(h+136,12);
+        e->mtime=(t+11644473600ULL)*10000000ULL; // unix seconds -> FILETIME ticks
+        return 1;
+    }
+}
+
+/* -------- public -------- */
+int ae_open(ArchiveEnum* e,const wchar_t* path,int kind){
+    memset(e,0,sizeof(*e));
+    e->kind=kind;
+    e->file=CreateFileW(path,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,NULL,OPEN_EXISTING,0,NULL);
+    if(e->file==INVALID_HANDLE_VALUE) return 0;
+    LARGE_INTEGER sz;
+    if(!GetFileSizeEx(e->file,&sz)){ ae_close(e); return 0; }
+    e->fileSize=(ULONGLONG)sz.QuadPart;
+    int ok= kind==ARCHIVE_ZIP ? zip_open(e) : kind==ARCHIVE_TAR && tar_open(e);
+    if(!ok) ae_close(e);
+    return ok;
+}
+
+int ae_next(ArchiveEnum* e){
+    if(e->file==INVALID_HANDLE_VALUE || !e->file) return 0;
+    return e->kind==ARCHIVE_ZIP ? zip_next(e) : tar_next(e);
+}
+
+void ae_close(ArchiveEnum* e){
+    free(e->buf);
+    if(e->file && e->file!=INVALID_HANDLE_VALUE) CloseHandle(e->file);
+    e->buf=NULL; e->bufLen=0; e->file=INVALID_HANDLE_VALUE;
+}
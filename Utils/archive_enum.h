@@ -0,0 +1,41 @@
+#ifndef ARCHIVE_ENUM_H
+#define ARCHIVE_ENUM_H
+
+#include <windows.h>
+#include "path_queue.h"
+
+#define ARCHIVE_NONE 0
+#define ARCHIVE_ZIP  1
+#define ARCHIVE_TAR  2
+
+// Lists archive members without extracting anything. Zip reads only the central directory;
+// tar reads each 512-byte header and seeks past the data. Both use plain reads, so a file that
+// shrinks or a share that drops mid-listing ends it with readError set instead of a fault.
+typedef struct {
+    int kind;
+    HANDLE file;
+    ULONGLONG fileSize;
+    int readError;
+
+    BYTE* buf;                  // zip: window of the file holding at least one whole record
+    ULONGLONG bufOff;
+    DWORD bufLen;
+    ULONGLONG pos, end, remaining;
+
+    ULONGLONG off;              // tar: next header
+    char longName[MAX_PATH_LEN*4];
+    int haveLong;               // 1: longName names the next member, -1: next member's name is too long
+
+    wchar_t name[MAX_PATH_LEN]; // member path, '/' separated, no leading or trailing '/'
+    int isDir;
+    ULONGLONG size;
+    ULONGLONG mtime;            // FILETIME ticks
+} ArchiveEnum;
+
+int archive_kind(const wchar_t* name);
+// 0 if the file cannot be opened or does not parse as kind; fileSize stays set once it opened
+int ae_open(ArchiveEnum* e,const wchar_t* path,int kind);
+int ae_next(ArchiveEnum* e);
+void ae_close(ArchiveEnum* e);
+
+#endif
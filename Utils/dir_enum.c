@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "dir_enum.h"
+
+int de_init(DirEnum* e){
+    memset(e,0,sizeof(*e));
+    e->h=INVALID_HANDLE_VALUE;
+    e->buf=malloc(DIR_ENUM_BUF);
+    return e->buf ? 1 : 0;
+}
+
+void de_free(DirEnum* e){
+    de_close(e);
+    free(e->buf); e->buf=NULL;
+}
+
+static FileId id128(const FILE_ID_128* f){
+    FileId id; memcpy(&id,f->Identifier,sizeof(id)); // little-endian: a 64-bit NTFS id lands in lo
+    return id;
+}
+
+// FILE_ID_INFO where the filesystem has it (ReFS ids need all 128 bits), else the 64-bit file index
+static int handle_identity(HANDLE h,DWORD* vol,FileId* id){
+    FILE_ID_INFO fi;
+    if(GetFileInformationByHandleEx(h,FileIdInfo,&fi,sizeof(fi))){
+        *vol=(DWORD)fi.VolumeSerialNumber;
+        *id=id128(&fi.FileId);
+        return 1;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    if(!GetFileInformationByHandle(h,&info)) return 0;
+    *vol=info.dwVolumeSerialNumber;
+    id->lo=((ULONGLONG)info.nFileIndexHigh<<32)|info.nFileIndexLow; id->hi=0;
+    return 1;
+}
+
+int de_open(DirEnum* e,const wchar_t* dir){
+    e->h=CreateFileW(dir,FILE_LIST_DIRECTORY,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                     NULL,OPEN_EXISTING,FILE_FLAG_BACKUP_SEMANTICS,NULL);
+    if(e->h==INVALID_HANDLE_VALUE) return 0;
+    if(!handle_identity(e->h,&e->vol,&e->dirId)){ de_close(e); return 0; }
+    e->cur=NULL; e->restart=1;
+    e->extd=!(e->noExtd && e->noExtdVol==e->vol);
+    return 1;
+}
+
+// Next buffer of entries. FAT, older NTFS and some redirectors reject the extended class on the
+// first call; the directory is then listed with FileIdBothDirectoryInfo (64-bit ids).
+static int de_fill(DirEnum* e){
+    if(e->extd){
+        FILE_INFO_BY_HANDLE_CLASS cls=e->restart ? FileIdExtdDirectoryRestartInfo : FileIdExtdDirectoryInfo;
+        if(GetFileInformationByHandleEx(e->h,cls,e->buf,DIR_ENUM_BUF)){ e->restart=0; e->cur=e->buf; return 1; }
+        if(!e->restart || GetLastError()==ERROR_NO_MORE_FILES) return 0;
+        e->extd=0; e->noExtd=1; e->noExtdVol=e->vol;
+    }
+    FILE_INFO_BY_HANDLE_CLASS cls=e->restart ? FileIdBothDirectoryRestartInfo : FileIdBothDirectoryInfo;
+    e->restart=0;
+    if(!GetFileInformationByHandleEx(e->h,cls,e->buf,DIR_ENUM_BUF)) return 0; // ERROR_NO_MORE_FILES or failure
+    e->cur=e->buf;
+    return 1;
+}
+
+int de_next(DirEnum* e){
+    for(;;){
+        DWORD next= e->cur ? *(const DWORD*)e->cur : 0; // NextEntryOffset leads both layouts
+        if(next) e->cur+=next;
+        else if(!de_fill(e)) return 0;
+
+        const WCHAR* name; DWORD nameBytes;
+        if(e->extd){
+            const FILE_ID_EXTD_DIR_INFO* fi=(const FILE_ID_EXTD_DIR_INFO*)e->cur;
+            name=fi->FileName; nameBytes=fi->FileNameLength;
+            e->attrs=fi->FileAttributes;
+            e->reparseTag=(fi->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? fi->ReparsePointTag : 0;
+            e->size=(ULONGLONG)fi->EndOfFile.QuadPart;
+            e->mtime=(ULONGLONG)fi->LastWriteTime.QuadPart;
+            e->fileId=id128(&fi->FileId);
+        } else {
+            const FILE_ID_BOTH_DIR_INFO* fi=(const FILE_ID_BOTH_DIR_INFO*)e->cur;
+            name=fi->FileName; nameBytes=fi->FileNameLength;
+            e->attrs=fi->FileAttributes;
+            e->reparseTag=(fi->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? fi->EaSize : 0;
+            e->size=(ULONGLONG)fi->EndOfFile.QuadPart;
+            e->mtime=(ULONGLONG)fi->LastWriteTime.QuadPart;
+            e->fileId.lo=(ULONGLONG)fi->FileId.QuadPart; e->fileId.hi=0;
+        }
+
+        size_t n=nameBytes/sizeof(wchar_t);
+        if(n>=MAX_PATH_LEN) continue; // doesn't fit the fixed-size path buffers downstream
+        wmemcpy(e->name,name,n); e->name[n]=0;
+        if(!wcscmp(e->name,L".")||!wcscmp(e->name,L"..")) continue;
+        return 1;
+    }
+}
+
+void de_close(DirEnum* e){
+    if(e->h!=INVALID_HANDLE_VALUE) CloseHandle(e->h);
+    e->h=INVALID_HANDLE_VALUE;
+    e->cur=NULL;
+}
+
+// Symlinks, junctions and mount points; other reparse points (dedup, cloud files) are plain entries
+int de_is_link(const DirEnum* e){
+    return (e->attrs & FILE_ATTRIBUTE_REPARSE_POINT) && IsReparseTagNameSurrogate(e->reparseTag);
+}
+
+// Identity of whatever path resolves to, following links
+int file_identity(const wchar_t* path,DWORD* vol,FileId* id){
+    HANDLE h=CreateFileW(path,FILE_READ_ATTRIBUTES,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+                         NULL,OPEN_EXISTING,FILE_FLAG_BACKUP_SEMANTICS,NULL);
+    if(h==INVALID_HANDLE_VALUE) return 0;
+    int ok=handle_identity(h,vol,id);
+    CloseHandle(h);
+    return ok;
+}
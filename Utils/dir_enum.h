@@ -0,0 +1,42 @@
+#ifndef DIR_ENUM_H
+#define DIR_ENUM_H
+
+#include <windows.h>
+#include "path_queue.h"
+#include "id_set.h"
+
+#define DIR_ENUM_BUF 65536
+
+// Handle-based directory listing (FileIdExtdDirectoryInfo, or FileIdBothDirectoryInfo where
+// the filesystem lacks it). Unlike FindFirstFileW it returns each entry's file id, so identity
+// checks need no per-file open.
+typedef struct {
+    HANDLE h;
+    BYTE* buf;
+    BYTE* cur;              // FILE_ID_EXTD_DIR_INFO or FILE_ID_BOTH_DIR_INFO, per extd
+    int restart;
+    int extd;
+    int noExtd;             // noExtdVol rejected the extended class; don't retry it there
+    DWORD noExtdVol;
+
+    DWORD vol;              // the opened directory (after following reparse points)
+    FileId dirId;
+
+    wchar_t name[MAX_PATH_LEN];
+    DWORD attrs;
+    DWORD reparseTag;       // valid when attrs has FILE_ATTRIBUTE_REPARSE_POINT
+    ULONGLONG size;
+    ULONGLONG mtime;        // FILETIME ticks
+    FileId fileId;
+} DirEnum;
+
+int de_init(DirEnum* e);
+void de_free(DirEnum* e);
+int de_open(DirEnum* e,const wchar_t* dir);
+int de_next(DirEnum* e);
+void de_close(DirEnum* e);
+
+int de_is_link(const DirEnum* e);
+int file_identity(const wchar_t* path,DWORD* vol,FileId* id);
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disk_usage.h"
+
+void du_init(DiskUsage* d,int maxDepth){
+    d->maxDepth=maxDepth;
+    d->done=NULL;
+}
+
+// A child holds a reference on its parent until its subtree has been rolled up.
+DuNode* du_node(DiskUsage* d,DuNode* parent,const wchar_t* path){
+    DuNode* n=calloc(1,sizeof(DuNode));
+    if(!n) return NULL;
+    n->parent=parent;
+    n->depth=parent ? parent->depth+1 : 0;
+    n->pending=1; // the directory's own listing
+    if(d->maxDepth<0 || n->depth<=d->maxDepth){
+        n->path=_wcsdup(path);
+        if(!n->path){ free(n); return NULL; }
+    }
+    if(parent) InterlockedIncrement(&parent->pending);
+    return n;
+}
+
+static void push_done(DiskUsage* d,DuNode* n){
+    DuNode* head;
+    do {
+        head=d->done;
+        n->next=head;
+    } while(InterlockedCompareExchangePointer((PVOID volatile*)&d->done,n,head)!=head);
+}
+
+// Called once per directory after its entries were counted; whichever thread finishes the
+// last piece of a subtree carries the total upwards.
+void du_finish_dir(DiskUsage* d,DuNode* n,ULONGLONG bytes,ULONGLONG files){
+    if(bytes) InterlockedExchangeAdd64(&n->bytes,(LONG64)bytes);
+    if(files) InterlockedExchangeAdd64(&n->files,(LONG64)files);
+    while(n && InterlockedDecrement(&n->pending)==0){
+        DuNode* parent=n->parent;
+        if(parent){
+            InterlockedExchangeAdd64(&parent->bytes,n->bytes);
+            InterlockedExchangeAdd64(&parent->files,n->files);
+        }
+        if(n->path) push_done(d,n);
+        else free(n);
+        n=parent;
+    }
+}
+
+static int cmp_size_desc(const void* a,const void* b){
+    const DuNode* x=*(const DuNode* const*)a;
+    const DuNode* y=*(const DuNode* const*)b;
+    if(x->bytes!=y->bytes) return x->bytes>y->bytes ? -1 : 1;
+    if(x->files!=y->files) return x->files>y->files ? -1 : 1;
+    return _wcsicmp(x->path,y->path);
+}
+
+// "<bytes>\t<files>\t<dir>", largest first
+void du_report(DiskUsage* d){
+    size_t count=0;
+    for(DuNode* n=d->done;n;n=n->next) count++;
+    if(!count) return;
+    DuNode** all=malloc(count*sizeof(DuNode*));
+    if(!all){ fwprintf(stderr,L"alloc failed\n"); return; }
+    size_t i=0;
+    for(DuNode* n=d->done;n;n=n->next) all[i++]=n;
+    qsort(all,count,sizeof(DuNode*),cmp_size_desc);
+    for(i=0;i<count;i++) wprintf(L"%llu\t%llu\t%s\n",(ULONGLONG)all[i]->bytes,(ULONGLONG)all[i]->files,all[i]->path);
+    free(all);
+}
+
+void du_free(DiskUsage* d){
+    DuNode* n=d->done;
+    while(n){ DuNode* next=n->next; free(n->path); free(n); n=next; }
+    d->done=NULL;
+}
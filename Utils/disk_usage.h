@@ -0,0 +1,30 @@
+#ifndef DISK_USAGE_H
+#define DISK_USAGE_H
+
+#include <windows.h>
+
+// One node per queued directory. pending counts the directory's own listing plus its
+// children that have not finished; when it drops to zero the subtree total is final and
+// is added to the parent, so rollups happen with atomic adds and no shared lock.
+typedef struct DuNode {
+    struct DuNode* parent;
+    struct DuNode* next;        // report list
+    wchar_t* path;              // only kept for nodes that will be reported
+    int depth;                  // root is 0
+    volatile LONG pending;
+    volatile LONG64 bytes;      // subtree totals once pending is 0
+    volatile LONG64 files;
+} DuNode;
+
+typedef struct {
+    int maxDepth;               // deepest level reported, -1: all
+    DuNode* volatile done;      // finished nodes kept for the report (lock-free stack)
+} DiskUsage;
+
+void du_init(DiskUsage* d,int maxDepth);
+DuNode* du_node(DiskUsage* d,DuNode* parent,const wchar_t* path);
+void du_finish_dir(DiskUsage* d,DuNode* n,ULONGLONG bytes,ULONGLONG files);
+void du_report(DiskUsage* d);
+void du_free(DiskUsage* d);
+
+#endif // DISK_USAGE_H
@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "id_set.h"
+#include "utils.h"
+
+#define SHARD_INIT_CAP 256
+#define SPILL_CHUNK    4096 // keys buffered per WriteFile
+
+static ULONGLONG mix64(ULONGLONG h){
+    // splitmix64 finalizer; file ids are mostly sequential so they need mixing
+    h^=h>>30; h*=0xbf58476d1ce4e5b9ULL;
+    h^=h>>27; h*=0x94d049bb133111ebULL;
+    h^=h>>31;
+    return h;
+}
+
+static ULONGLONG id_hash(DWORD vol,FileId id){
+    return mix64(id.lo ^ ((ULONGLONG)vol<<32 | vol) ^ mix64(id.hi));
+}
+
+static int id_eq(FileId a,FileId b){ return a.lo==b.lo && a.hi==b.hi; }
+
+int idset_init(IdSet* s){
+    memset(s,0,sizeof(*s));
+    for(int i=0;i<IDSET_SHARDS;i++){
+        IdShard* sh=&s->shards[i];
+        sh->slots=calloc(SHARD_INIT_CAP,sizeof(IdKey));
+        if(!sh->slots){ for(int k=0;k<i;k++){ free(s->shards[k].slots); DeleteCriticalSection(&s->shards[k].cs); } return 0; }
+        sh->cap=SHARD_INIT_CAP; sh->count=0;
+        InitializeCriticalSectionAndSpinCount(&sh->cs,4000);
+    }
+    return 1;
+}
+
+void idset_destroy(IdSet* s){
+    for(int i=0;i<IDSET_SHARDS;i++){
+        free(s->shards[i].slots);
+        s->shards[i].slots=NULL;
+        DeleteCriticalSection(&s->shards[i].cs);
+    }
+    for(int r=0;r<s->runCount;r++){ CloseHandle(s->runs[r].file); free(s->runs[r].fences); free(s->runs[r].bloom); }
+    free(s->runs);
+}
+
+int idset_set_budget(IdSet* s,size_t maxKeys,const wchar_t* spillDir){
+    if(spillDir && wcslen(spillDir)>=MAX_PATH) return 0;
+    wcscpy_s(s->spillDir,MAX_PATH,spillDir ? spillDir : L"");
+    HANDLE probe=create_spill_file(s->spillDir); // report an unusable directory now, not mid-scan
+    if(probe==INVALID_HANDLE_VALUE) return 0;
+    CloseHandle(probe);
+    s->memLimit=maxKeys ? maxKeys : 1;
+    return 1;
+}
+
+static int shard_grow(IdShard* sh){
+    size_t cap=sh->cap*2;
+    IdKey* slots=calloc(cap,sizeof(IdKey));
+    if(!slots) return 0;
+    for(size_t k=0;k<sh->cap;k++){
+        IdKey* key=&sh->slots[k]; if(!key->used) continue;
+        size_t i=(size_t)(id_hash(key->vol,key->id)&(cap-1));
+        while(slots[i].used) i=(i+1)&(cap-1);
+        slots[i]=*key;
+    }
+    free(sh->slots); sh->slots=slots; sh->cap=cap;
+    return 1;
+}
+
+/* -------- spilled runs -------- */
+static int cmp_disk_key(const void* pa,const void* pb){
+    const IdDiskKey* a=pa; const IdDiskKey* b=pb;
+    if(a->vol!=b->vol) return a->vol<b->vol ? -1 : 1;
+    if(a->id.hi!=b->id.hi) return a->id.hi<b->id.hi ? -1 : 1;
+    if(a->id.lo!=b->id.lo) return a->id.lo<b->id.lo ? -1 : 1;
+    return 0;
+}
+
+static size_t bloom_bit(ULONGLONG h,int i,size_t bits){
+    ULONGLONG h2=(h>>33|h<<31)|1; // double hashing
+    return (size_t)((h+(ULONGLONG)i*h2)%bits);
+}
+
+static int run_contains(IdSet* s,IdRun* r,IdDiskKey* key,ULONGLONG h){
+    for(int i=0;i<IDSET_BLOOM_K;i++){
+        size_t bit=bloom_bit(h,i,r->bloomBits);
+        if(!(r->bloom[bit>>3] & (1<<(bit&7)))) return 0;
+    }
+    // last block whose first key is <= key
+    size_t blocks=(r->count+IDSET_FENCE-1)/IDSET_FENCE, lo=0, hi=blocks;
+    while(hi-lo>1){ size_t mid=(lo+hi)/2; if(cmp_disk_key(&r->fences[mid],key)<=0) lo=mid; else hi=mid; }
+    size_t first=lo*IDSET_FENCE, n=r->count-first; if(n>IDSET_FENCE) n=IDSET_FENCE;
+    IdDiskKey block[IDSET_FENCE];
+    if(!file_read_at(r->file,first*sizeof(IdDiskKey),block,(DWORD)(n*sizeof(IdDiskKey)))) return 0;
+    return bsearch(key,block,n,sizeof(IdDiskKey),cmp_disk_key)!=NULL;
+}
+
+/* -------- run writer: appends sorted keys, building fences and the Bloom filter -------- */
+typedef struct {
+    IdSet* s;
+    IdRun r;
+    IdDiskKey* buf;
+    size_t fill;
+    ULONGLONG written;
+    int ok;
+} RunWriter;
+
+static int rw_begin(RunWriter* w,IdSet* s,size_t total){
+    memset(w,0,sizeof(*w));
+    w->s=s;
+    w->r.file=create_spill_file(s->spillDir);
+    w->r.bloomBits=total*IDSET_BLOOM_BITS;
+    w->r.fences=malloc(((total+IDSET_FENCE-1)/IDSET_FENCE)*sizeof(IdDiskKey));
+    w->r.bloom=calloc((w->r.bloomBits+7)/8,1);
+    w->buf=malloc(SPILL_CHUNK*sizeof(IdDiskKey));
+    w->ok= total && w->r.file!=INVALID_HANDLE_VALUE && w->r.fences && w->r.bloom && w->buf;
+    return w->ok;
+}
+
+static void rw_flush(RunWriter* w){
+    if(w->ok && w->fill)
+        w->ok=file_write_at(w->r.file,w->written,w->buf,(DWORD)(w->fill*sizeof(IdDiskKey)));
+    w->written+=w->fill*sizeof(IdDiskKey);
+    w->fill=0;
+}
+
+static void rw_put(RunWriter* w,const IdDiskKey* k){
+    ULONGLONG h=id_hash(k->vol,k->id);
+    for(int b=0;b<IDSET_BLOOM_K;b++){ size_t bit=bloom_bit(h,b,w->r.bloomBits); w->r.bloom[bit>>3]|=(BYTE)(1<<(bit&7)); }
+    if(w->r.count%IDSET_FENCE==0) w->r.fences[w->r.count/IDSET_FENCE]=*k;
+    w->r.count++;
+    w->buf[w->fill++]=*k;
+    if(w->fill==SPILL_CHUNK) rw_flush(w);
+}
+
+static int rw_end(RunWriter* w){
+    rw_flush(w);
+    free(w->buf);
+    if(!w->ok){
+        if(w->r.file!=INVALID_HANDLE_VALUE) CloseHandle(w->r.file);
+        free(w->r.fences); free(w->r.bloom);
+    }
+    return w->ok;
+}
+
+// Sequential reader over one existing run
+typedef struct {
+    IdRun* r;
+    size_t pos, fill, at;
+    IdDiskKey block[IDSET_FENCE];
+} RunCursor;
+
+static const IdDiskKey* rc_peek(IdSet* s,RunCursor* c){
+    if(c->at==c->fill){
+        if(c->pos==c->r->count) return NULL;
+        size_t n=c->r->count-c->pos; if(n>IDSET_FENCE) n=IDSET_FENCE;
+        if(!file_read_at(c->r->file,c->pos*sizeof(IdDiskKey),c->block,(DWORD)(n*sizeof(IdDiskKey)))) return NULL;
+        c->pos+=n; c->fill=n; c->at=0;
+    }
+    return &c->block[c->at];
+}
+
+// Moves every in-memory key into a new sorted run. Takes all shard locks, so no add is in flight.
+// Once IDSET_MAX_RUNS exist, the existing runs are merged into the new one in a single pass;
+// every add waits for that rewrite, a pause that grows with the number of spilled keys.
+static void spill_runs(IdSet* s){
+    for(int i=0;i<IDSET_SHARDS;i++) EnterCriticalSection(&s->shards[i].cs);
+
+    size_t n=0;
+    for(int i=0;i<IDSET_SHARDS;i++) n+=s->shards[i].count;
+    IdDiskKey* keys=malloc(n*sizeof(IdDiskKey));
+    int ok= n && keys;
+    if(ok && s->runCount==s->runCap){
+        int cap=s->runCap? s->runCap*2 : IDSET_MAX_RUNS;
+        IdRun* runs=realloc(s->runs,cap*sizeof(IdRun));
+        if(runs){ s->runs=runs; s->runCap=cap; } else ok=0;
+    }
+
+    if(ok){
+        size_t k=0;
+        for(int i=0;i<IDSET_SHARDS;i++){
+            IdShard* sh=&s->shards[i];
+            for(size_t j=0;j<sh->cap;j++) if(sh->slots[j].used){ keys[k].id=sh->slots[j].id; keys[k].vol=sh->slots[j].vol; k++; }
+        }
+        qsort(keys,n,sizeof(IdDiskKey),cmp_disk_key);
+
+        int merge= s->runCount>=IDSET_MAX_RUNS;
+        size_t total=n;
+        if(merge) for(int r=0;r<s->runCount;r++) total+=s->runs[r].count;
+
+        RunWriter w;
+        RunCursor* cur= merge ? malloc(s->runCount*sizeof(RunCursor)) : NULL;
+        if(rw_begin(&w,s,total) && (!merge || cur)){
+            if(merge){
+                for(int r=0;r<s->runCount;r++){ cur[r].r=&s->runs[r]; cur[r].pos=cur[r].fill=cur[r].at=0; }
+                size_t m=0;
+                for(;;){
+                    // keys are unique across runs and memory, so ties cannot happen
+                    const IdDiskKey* best= m<n ? &keys[m] : NULL; int from=-1;
+                    for(int r=0;r<s->runCount;r++){
+                        const IdDiskKey* c=rc_peek(s,&cur[r]);
+                        if(c && (!best || cmp_disk_key(c,best)<0)){ best=c; from=r; }
+                    }
+                    if(!best) break;
+                    rw_put(&w,best);
+                    if(from<0) m++; else cur[from].at++;
+                }
+                if(w.r.count!=total) w.ok=0; // a run failed to read back
+            } else {
+                for(size_t m=0;m<n;m++) rw_put(&w,&keys[m]);
+            }
+        } else w.ok=0;
+        free(cur);
+        ok=rw_end(&w);
+
+        if(ok){
+            if(merge){
+                for(int r=0;r<s->runCount;r++){ CloseHandle(s->runs[r].file); free(s->runs[r].fences); free(s->runs[r].bloom); }
+                s->runCount=0;
+            }
+            s->runs[s->runCount++]=w.r;
+        }
+    }
+
+    if(ok){
+        for(int i=0;i<IDSET_SHARDS;i++){
+            IdShard* sh=&s->shards[i];
+            IdKey* slots=calloc(SHARD_INIT_CAP,sizeof(IdKey));
+            if(slots){ free(sh->slots); sh->slots=slots; sh->cap=SHARD_INIT_CAP; }
+            else memset(sh->slots,0,sh->cap*sizeof(IdKey));
+            sh->count=0;
+        }
+        InterlockedExchange64(&s->inMemory,0);
+    } else if(n){
+        fwprintf(stderr,L"dedup spill failed, keeping %zu ids in memory\n",n);
+        s->memLimit*=2;
+    }
+    free(keys);
+
+    for(int i=IDSET_SHARDS-1;i>=0;i--) LeaveCriticalSection(&s->shards[i].cs);
+}
+
+// Returns 1 if (vol,id) was not in the set yet (and is now), 0 if it was already present.
+int idset_add(IdSet* s,DWORD vol,FileId id){
+    ULONGLONG h=id_hash(vol,id);
+    IdShard* sh=&s->shards[h>>58 & (IDSET_SHARDS-1)];
+    EnterCriticalSection(&sh->cs);
+    if((sh->count+1)*10>sh->cap*7 && !shard_grow(sh)){
+        LeaveCriticalSection(&sh->cs);
+        fwprintf(stderr,L"alloc failed\n");
+        return 1; // can't remember it; emitting twice beats dropping it
+    }
+    size_t i=(size_t)(h&(sh->cap-1));
+    while(sh->slots[i].used){
+        if(id_eq(sh->slots[i].id,id) && sh->slots[i].vol==vol){ LeaveCriticalSection(&sh->cs); return 0; }
+        i=(i+1)&(sh->cap-1);
+    }
+    if(s->runCount){
+        IdDiskKey key; key.id=id; key.vol=vol;
+        for(int r=0;r<s->runCount;r++)
+            if(run_contains(s,&s->runs[r],&key,h)){ LeaveCriticalSection(&sh->cs); return 0; }
+    }
+    sh->slots[i].id=id; sh->slots[i].vol=vol; sh->slots[i].used=1;
+    sh->count++;
+    LeaveCriticalSection(&sh->cs);
+
+    if(s->memLimit && (size_t)InterlockedIncrement64(&s->inMemory)>s->memLimit
+       && !InterlockedCompareExchange(&s->spilling,1,0)){
+        spill_runs(s);
+        InterlockedExchange(&s->spilling,0);
+    }
+    return 1;
+}
+
+size_t idset_count(IdSet* s){
+    size_t n=0;
+    for(int i=0;i<IDSET_SHARDS;i++){
+        EnterCriticalSection(&s->shards[i].cs);
+        n+=s->shards[i].count;
+        LeaveCriticalSection(&s->shards[i].cs);
+    }
+    for(int r=0;r<s->runCount;r++) n+=s->runs[r].count;
+    return n;
+}
@@ -0,0 +1,64 @@
+#ifndef ID_SET_H
+#define ID_SET_H
+
+#include <windows.h>
+
+#define IDSET_SHARDS 64   // power of two; shard is picked from the top bits of the key hash
+#define IDSET_FENCE  256  // keys per on-disk block; one fence key per block stays in memory
+#define IDSET_BLOOM_BITS 10
+#define IDSET_BLOOM_K    6
+#define IDSET_MAX_RUNS   8    // more runs are merged into one, so a lookup probes at most this many
+
+// 128-bit file id; NTFS ids fit in lo, ReFS (and Dev Drive) need both halves
+typedef struct {
+    ULONGLONG lo, hi;
+} FileId;
+
+// (volume serial, file id) — identifies a file independent of the path it was reached by
+typedef struct {
+    FileId id;
+    DWORD vol;
+    DWORD used;
+} IdKey;
+
+#pragma pack(push, 4)
+typedef struct {
+    FileId id;
+    DWORD vol;
+} IdDiskKey;
+#pragma pack(pop)
+
+typedef struct {
+    IdKey* slots;       // open addressing, linear probing
+    size_t cap, count;
+    CRITICAL_SECTION cs;
+} IdShard;
+
+// A sorted run of keys that were moved out of memory, with a Bloom filter in front of it.
+// Each run has its own delete-on-close file, so a merge gives back the space of its inputs.
+typedef struct {
+    HANDLE file;
+    size_t count;
+    IdDiskKey* fences;
+    BYTE* bloom;
+    size_t bloomBits;
+} IdRun;
+
+typedef struct {
+    IdShard shards[IDSET_SHARDS];
+
+    size_t memLimit;            // keys held in memory before spilling; 0 = unlimited
+    volatile LONG64 inMemory;
+    volatile LONG spilling;
+    wchar_t spillDir[MAX_PATH]; // empty: %TEMP%
+    IdRun* runs;                // only changed while every shard lock is held
+    int runCount, runCap;
+} IdSet;
+
+int idset_init(IdSet* s);
+void idset_destroy(IdSet* s);
+int idset_set_budget(IdSet* s,size_t maxKeys,const wchar_t* spillDir);
+int idset_add(IdSet* s,DWORD vol,FileId id);
+size_t idset_count(IdSet* s);
+
+#endif
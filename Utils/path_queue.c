@@ -1,13 +1,34 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <wchar.h>
 
 #include "path_queue.h"
+#include "utils.h"
+
+#define SPILL_REC_HDR (3*sizeof(WORD)+sizeof(void*))   // length, depth, kind, ctx
+#define SPILL_REC_MAX (SPILL_REC_HDR+MAX_PATH_LEN*sizeof(wchar_t))
+#define SPILL_FILE_MAX (64ULL<<20)
 
 int q_init(DirQueue* q) {
-    q->items = malloc(sizeof(wchar_t[QUEUE_CAP][MAX_PATH_LEN]));
+    q->items = malloc(sizeof(DirItem) * QUEUE_CAP);
     if (!q->items) return 0;
+    q->cap = QUEUE_CAP;
+    q->count = 0;
     q->head = q->tail = 0;
+    q->lifo = 0;
+    q->closed = 0;
+    q->waiting = 0;
+    q->spill = INVALID_HANDLE_VALUE;
+    q->spillEnd = 0;
+    q->spillFileMax = SPILL_FILE_MAX;
+    q->spillDir[0] = 0;
+    q->batches = NULL;
+    q->batchCount = q->batchCap = 0;
+    q->spillBuf = NULL;
+    q->stage = NULL;
+    q->stageCount = q->stageCap = 0;
+    q->failed = 0;
     InitializeCriticalSection(&q->cs);
     q->slotsSem = CreateSemaphore(NULL, QUEUE_CAP, QUEUE_CAP, NULL);
     q->itemsSem = CreateSemaphore(NULL, 0, QUEUE_CAP, NULL);
@@ -19,31 +40,223 @@ void q_destroy(DirQueue* q) {
     if (q->items) free(q->items);
     if (q->slotsSem) CloseHandle(q->slotsSem);
     if (q->itemsSem) CloseHandle(q->itemsSem);
+    // Older FIFO files still hold unread batches; each file's batches are contiguous
+    HANDLE last = q->spill;
+    for (int i = 0; i < q->batchCount; i++) {
+        HANDLE f = q->batches[i].file;
+        if (f != last && f != q->spill) CloseHandle(f);
+        last = f;
+    }
+    if (q->spill && q->spill != INVALID_HANDLE_VALUE) CloseHandle(q->spill);
+    free(q->batches);
+    free(q->spillBuf);
+    free(q->stage);
     DeleteCriticalSection(&q->cs);
 }
 
-int q_push(DirQueue* q, const wchar_t* path) {
-    WaitForSingleObject(q->slotsSem, INFINITE);
+// Must be called before the queue is used, after lifo is set. memCap bounds the items held
+// in memory; FIFO splits it between the ring and the staging buffer for new pushes.
+int q_enable_spill(DirQueue* q, LONG memCap, const wchar_t* dir) {
+    if (memCap < 2) memCap = 2;
+    if (memCap > QUEUE_CAP) memCap = QUEUE_CAP;
+    LONG ringCap = q->lifo ? memCap : memCap - memCap / 2;
+    DirItem* items = realloc(q->items, sizeof(DirItem) * ringCap);
+    if (!items) return 0;
+    q->items = items;
+    q->cap = ringCap;
+    if (!q->lifo) {
+        q->stageCap = memCap / 2;
+        q->stage = malloc(sizeof(DirItem) * q->stageCap);
+        if (!q->stage) return 0;
+    }
+    q->spillBuf = malloc((memCap / 2 + 1) * SPILL_REC_MAX);
+    if (!q->spillBuf) return 0;
+    if (dir && wcslen(dir) >= MAX_PATH) return 0;
+    wcscpy_s(q->spillDir, MAX_PATH, dir ? dir : L"");
+    q->spill = create_spill_file(dir);
+    if (q->spill == INVALID_HANDLE_VALUE) return 0;
+    // item count is no longer bounded by the ring
+    CloseHandle(q->itemsSem);
+    q->itemsSem = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+    return q->itemsSem ? 1 : 0;
+}
+
+// Stop accepting work; producers blocked on a full queue give up within one wait interval
+void q_close(DirQueue* q) {
+    InterlockedExchange(&q->closed, 1);
+}
+
+/* -------- spill batches (called with cs held) -------- */
+// Appends n items, read from ring index first on, as the newest batch.
+static int write_batch(DirQueue* q, const DirItem* ring, LONG ringCap, LONG first, LONG n) {
+    if (q->batchCount == q->batchCap) {
+        int cap = q->batchCap ? q->batchCap * 2 : 16;
+        SpillBatch* b = realloc(q->batches, cap * sizeof(SpillBatch));
+        if (!b) return 0;
+        q->batches = b; q->batchCap = cap;
+    }
+    BYTE* p = q->spillBuf;
+    for (LONG k = 0; k < n; k++) {
+        const DirItem* it = &ring[(first + k) % ringCap];
+        WORD hdr[3] = { (WORD)wcslen(it->path), (WORD)it->depth, (WORD)it->kind };
+        memcpy(p, hdr, sizeof(hdr));
+        memcpy(p + sizeof(hdr), &it->ctx, sizeof(void*));
+        memcpy(p + SPILL_REC_HDR, it->path, hdr[0] * sizeof(wchar_t));
+        p += SPILL_REC_HDR + hdr[0] * sizeof(wchar_t);
+    }
+    if (!q->lifo && q->spillEnd >= q->spillFileMax) {
+        // The current file is left to the batches already in it
+        HANDLE f = create_spill_file(q->spillDir);
+        if (f == INVALID_HANDLE_VALUE) return 0;
+        q->spill = f;
+        q->spillEnd = 0;
+    }
+    SpillBatch* b = &q->batches[q->batchCount];
+    b->file = q->spill; b->off = q->spillEnd; b->bytes = (DWORD)(p - q->spillBuf); b->count = n;
+    if (!file_write_at(b->file, b->off, q->spillBuf, b->bytes)) return 0;
+    q->batchCount++;
+    q->spillEnd += b->bytes;
+    return 1;
+}
+
+// LIFO: the oldest half of the full ring is popped last, so it goes to disk.
+static int spill_half(DirQueue* q) {
+    LONG n = q->count / 2;
+    if (n < 1) n = 1;
+    if (!write_batch(q, q->items, q->cap, q->head, n)) return 0;
+    q->head = (q->head + n) % q->cap;
+    q->count -= n;
+    return 1;
+}
+
+// FIFO: once the ring is full, new items queue up behind it in the staging buffer, and
+// each full buffer becomes the newest batch. Pops drain the ring, then the batches
+// oldest first, then the buffer, so spilling never reorders the queue.
+static int stage_item(DirQueue* q, const DirItem* item) {
+    q->stage[q->stageCount++] = *item;
+    if (q->stageCount < q->stageCap) return 1;
+    if (!write_batch(q, q->stage, q->stageCap, 0, q->stageCount)) return 0;
+    q->stageCount = 0;
+    return 1;
+}
+
+static void unstage(DirQueue* q) {
+    memcpy(q->items, q->stage, q->stageCount * sizeof(DirItem));
+    q->head = 0;
+    q->tail = q->stageCount % q->cap;
+    q->count = q->stageCount;
+    q->stageCount = 0;
+}
+
+// Refills the (empty) ring: FIFO resumes with the oldest batch, LIFO with the newest.
+static int load_batch(DirQueue* q) {
+    int idx = q->lifo ? q->batchCount - 1 : 0;
+    SpillBatch b = q->batches[idx];
+    if (!file_read_at(b.file, b.off, q->spillBuf, b.bytes)) return 0;
+    memmove(&q->batches[idx], &q->batches[idx + 1], (q->batchCount - idx - 1) * sizeof(SpillBatch));
+    q->batchCount--;
+    if (b.file == q->spill) {
+        if (q->lifo) q->spillEnd = b.off;         // the newest batch: cut the file back to it
+        else if (!q->batchCount) q->spillEnd = 0; // everything is back in memory
+    } else if (!q->batchCount || q->batches[0].file != b.file) {
+        CloseHandle(b.file); // last batch of an older FIFO file
+    }
+
+    const BYTE* p = q->spillBuf;
+    for (LONG k = 0; k < b.count; k++) {
+        WORD hdr[3];
+        memcpy(hdr, p, sizeof(hdr));
+        DirItem* it = &q->items[k];
+        memcpy(&it->ctx, p + sizeof(hdr), sizeof(void*));
+        memcpy(it->path, p + SPILL_REC_HDR, hdr[0] * sizeof(wchar_t));
+        it->path[hdr[0]] = 0;
+        it->depth = hdr[1];
+        it->kind = hdr[2];
+        p += SPILL_REC_HDR + hdr[0] * sizeof(wchar_t);
+    }
+    q->head = 0;
+    q->tail = b.count % q->cap;
+    q->count = b.count;
+    return 1;
+}
+
+int q_push_item(DirQueue* q, const DirItem* item) {
+    int spilling = q->spill != INVALID_HANDLE_VALUE;
+    while (!spilling) {
+        DWORD r = WaitForSingleObject(q->slotsSem, 100);
+        if (r != WAIT_TIMEOUT) break;
+        if (q->closed) return 0;
+    }
     EnterCriticalSection(&q->cs);
-    wcscpy_s(q->items[q->tail], MAX_PATH_LEN, path);
-    q->tail = (q->tail + 1) % QUEUE_CAP;
+    if (q->failed) { LeaveCriticalSection(&q->cs); return 0; }
+    int ok = 1;
+    if (spilling && !q->lifo && (q->count == q->cap || q->batchCount || q->stageCount)) {
+        ok = stage_item(q, item);
+    } else {
+        if (spilling && q->count == q->cap) ok = spill_half(q);
+        if (ok) {
+            q->items[q->tail] = *item;
+            q->tail = (q->tail + 1) % q->cap;
+            q->count++;
+        }
+    }
+    if (!ok) {
+        q->failed = 1;
+        LeaveCriticalSection(&q->cs);
+        fwprintf(stderr, L"Queue spill failed\n");
+        return 0;
+    }
     LeaveCriticalSection(&q->cs);
     ReleaseSemaphore(q->itemsSem, 1, NULL);
     return 1;
 }
 
-int q_pop(DirQueue* q, wchar_t* out, volatile LONG* shutdown) {
+int q_pop_item(DirQueue* q, DirItem* out, volatile LONG* shutdown) {
+    InterlockedIncrement(&q->waiting);
     for (;;) {
+        if (*shutdown) { InterlockedDecrement(&q->waiting); return 0; }
         DWORD r = WaitForSingleObject(q->itemsSem, 100);
-        if (r == WAIT_TIMEOUT) {
-            if (*shutdown) return 0;
-            continue;
-        }
+        if (r == WAIT_TIMEOUT) continue;
+        if (*shutdown) { InterlockedDecrement(&q->waiting); return 0; } // woken to exit, or stopping early
+        InterlockedDecrement(&q->waiting);
         EnterCriticalSection(&q->cs);
-        wcscpy_s(out, MAX_PATH_LEN, q->items[q->head]);
-        q->head = (q->head + 1) % QUEUE_CAP;
+        if (q->count == 0) {
+            if (q->batchCount) {
+                if (!load_batch(q)) q->failed = 1;
+            } else if (q->stageCount) unstage(q);
+            else q->failed = 1;
+        }
+        if (q->failed) {
+            LeaveCriticalSection(&q->cs);
+            fwprintf(stderr, L"Queue spill read failed\n");
+            return 0;
+        }
+        if (q->lifo) {
+            q->tail = (q->tail + q->cap - 1) % q->cap;
+            *out = q->items[q->tail];
+        } else {
+            *out = q->items[q->head];
+            q->head = (q->head + 1) % q->cap;
+        }
+        q->count--;
         LeaveCriticalSection(&q->cs);
-        ReleaseSemaphore(q->slotsSem, 1, NULL);
+        if (q->spill == INVALID_HANDLE_VALUE) ReleaseSemaphore(q->slotsSem, 1, NULL);
         return 1;
     }
-}
\ No newline at end of file
+}
+
+int q_push(DirQueue* q, const wchar_t* path) {
+    DirItem item;
+    wcscpy_s(item.path, MAX_PATH_LEN, path);
+    item.depth = 0;
+    item.kind = 0;
+    item.ctx = NULL;
+    return q_push_item(q, &item);
+}
+
+int q_pop(DirQueue* q, wchar_t* out, volatile LONG* shutdown) {
+    DirItem item;
+    if (!q_pop_item(q, &item, shutdown)) return 0;
+    wcscpy_s(out, MAX_PATH_LEN, item.path);
+    return 1;
+}
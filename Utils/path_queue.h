@@ -7,17 +7,55 @@
 #define QUEUE_CAP      8192
 
 typedef struct {
-    wchar_t (*items)[MAX_PATH_LEN];  // pointer to heap array
+    wchar_t path[MAX_PATH_LEN];
+    int depth;                 // root is 0
+    int kind;                  // 0: directory, otherwise an ARCHIVE_* kind (archive_enum.h)
+    void* ctx;                 // caller's per-directory state (--du node), carried through spills
+} DirItem;
+
+typedef struct {
+    HANDLE file;
+    ULONGLONG off;
+    DWORD bytes;
+    LONG count;
+} SpillBatch;
+
+typedef struct {
+    DirItem* items;            // pointer to heap array
+    LONG cap;                  // ring capacity
+    LONG count;
     LONG head;
     LONG tail;
+    int lifo;                  // pop newest first (depth-first) instead of oldest
+    volatile LONG closed;      // set by q_close; pushers stop waiting for slots
+    volatile LONG waiting;     // consumers currently blocked in q_pop
     CRITICAL_SECTION cs;
     HANDLE slotsSem;    // counts free slots
     HANDLE itemsSem;    // counts queued items
+
+    // Spill mode (q_enable_spill): pushes never block. Items beyond the in-memory budget are
+    // written to the spill file in batches and read back, in queue order, once the ring runs dry.
+    // LIFO reads the newest batch and cuts the file back to it. FIFO reads the oldest, so it
+    // starts a new file past spillFileMax and closes (deletes) each older one once drained.
+    HANDLE spill;              // file new batches go to
+    ULONGLONG spillEnd;
+    ULONGLONG spillFileMax;
+    wchar_t spillDir[MAX_PATH];
+    SpillBatch* batches;
+    int batchCount, batchCap;
+    BYTE* spillBuf;
+    DirItem* stage;            // FIFO: pushes waiting behind the spilled batches
+    LONG stageCount, stageCap;
+    volatile LONG failed;      // spill file I/O failed; the queue has lost items
 } DirQueue;
 
 int q_init(DirQueue* q);
 void q_destroy(DirQueue* q);
+void q_close(DirQueue* q);
+int q_enable_spill(DirQueue* q,LONG memCap,const wchar_t* dir);
+int q_push_item(DirQueue* q,const DirItem* item);
+int q_pop_item(DirQueue* q,DirItem* out,volatile LONG* shutdown);
 int q_push(DirQueue* q,const wchar_t* path);
 int q_pop(DirQueue* q,wchar_t* out,volatile LONG* shutdown);
 
-#endif
\ No newline at end of file
+#endif
@@ -51,8 +51,47 @@ char* wchar_to_utf8(const wchar_t* wstr) {
     return buffer;
 }
 
+void path_concat(wchar_t* out,size_t outLen,const wchar_t* base,const wchar_t* name){
+    size_t len=wcslen(base);
+    if(len>0 && base[len-1]!=L'\\' && base[len-1]!=L'/') 
+        swprintf(out,outLen,L"%s\\%s",base,name);
+    else 
+        swprintf(out,outLen,L"%s%s",base,name);
+}
+
+/* -------- spill files -------- */
+// Scratch file for data pushed out of memory; removed by the OS when the handle is closed.
+void* create_spill_file(const wchar_t* dir) {
+    wchar_t tmpDir[MAX_PATH], name[MAX_PATH];
+    if (!dir || !dir[0]) {
+        DWORD n = GetTempPathW(MAX_PATH, tmpDir);
+        if (n == 0 || n >= MAX_PATH) return INVALID_HANDLE_VALUE;
+        dir = tmpDir;
+    }
+    if (!GetTempFileNameW(dir, L"ffm", 0, name)) return INVALID_HANDLE_VALUE;
+    return CreateFileW(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+}
+
+// Positional I/O, so threads sharing a handle never depend on its file pointer
+int file_write_at(void* h, unsigned long long off, const void* buf, unsigned long len) {
+    OVERLAPPED ov = {0};
+    ov.Offset = (DWORD)off; ov.OffsetHigh = (DWORD)(off >> 32);
+    DWORD done = 0;
+    return WriteFile(h, buf, len, &done, &ov) && done == len;
+}
+
+int file_read_at(void* h, unsigned long long off, void* buf, unsigned long len) {
+    OVERLAPPED ov = {0};
+    ov.Offset = (DWORD)off; ov.OffsetHigh = (DWORD)(off >> 32);
+    DWORD done = 0;
+    return ReadFile(h, buf, len, &done, &ov) && done == len;
+}
+
 /* -------- glob matching -------- */
-int match_glob(const wchar_t* str, const wchar_t* pat, int allowSlashCross) {
+// calls (optional) counts every invocation, i.e. how much backtracking a pattern needed
+static int glob_rec(const wchar_t* str, const wchar_t* pat, int allowSlashCross, unsigned long long* calls) {
+    if (calls) (*calls)++;
     while (*pat) {
         if (*pat == L'*') {
             int dbl = (pat[1] == L'*');
@@ -64,7 +103,7 @@ int match_glob(const wchar_t* str, const wchar_t* pat, int allowSlashCross) {
             if (dbl) {
                 // '**' can match zero or more chars, including '/'
                 for (const wchar_t* s = str; ; ++s) {
-                    if (match_glob(s, pat, 1)) return 1;
+                    if (glob_rec(s, pat, 1, calls)) return 1;
                     if (!*s) break;
                 }
                 return 0;
@@ -72,7 +111,7 @@ int match_glob(const wchar_t* str, const wchar_t* pat, int allowSlashCross) {
                 // single '*' must match at least one character, optionally stopping at '/'
                 if (!*str) return 0; // nothing to match
                 for (const wchar_t* s = str; *s && (allowSlashCross || *s != L'/'); ++s) {
-                    if (match_glob(s + 1, pat, allowSlashCross)) return 1;
+                    if (glob_rec(s + 1, pat, allowSlashCross, calls)) return 1;
                 }
                 return 0;
             }
@@ -85,6 +124,14 @@ int match_glob(const wchar_t* str, const wchar_t* pat, int allowSlashCross) {
     return *str == 0;
 }
 
+int match_glob(const wchar_t* str, const wchar_t* pat, int allowSlashCross) {
+    return glob_rec(str, pat, allowSlashCross, NULL);
+}
+
+int match_glob_counted(const wchar_t* str, const wchar_t* pat, int allowSlashCross, unsigned long long* calls) {
+    return glob_rec(str, pat, allowSlashCross, calls);
+}
+
 int contains_dir_segment(const wchar_t* rel, const wchar_t* name) {
     size_t n = wcslen(name);
     const wchar_t* p = rel;
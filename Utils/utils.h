@@ -7,8 +7,14 @@ void trim_ws(wchar_t* s);
 void to_forward_slashes(wchar_t* s);
 int ieq(wchar_t a, wchar_t b);
 char* wchar_to_utf8(const wchar_t* wstr);
+void path_concat(wchar_t* out,size_t outLen,const wchar_t* base,const wchar_t* name);
+
+void* create_spill_file(const wchar_t* dir);
+int file_write_at(void* h,unsigned long long off,const void* buf,unsigned long len);
+int file_read_at(void* h,unsigned long long off,void* buf,unsigned long len);
 
 int match_glob(const wchar_t* str,const wchar_t* pat,int allowSlashCross);
+int match_glob_counted(const wchar_t* str,const wchar_t* pat,int allowSlashCross,unsigned long long* calls);
 int contains_dir_segment(const wchar_t* rel,const wchar_t* name);
 
 #endif
\ No newline at end of file
@@ -4,12 +4,17 @@
 #include <wchar.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/stat.h>
 #include "Utils/utils.h"
 #include "Utils/path_queue.h"
+#include "Utils/id_set.h"
+#include "Utils/dir_enum.h"
+#include "Utils/archive_enum.h"
+#include "Utils/disk_usage.h"
 #include "pattern_matching.h"
+#include "tree_diff.h"
 
 #define MAX_THREADS 16
+#define BUDGET_BYTES_PER_ID 72   // IdKey at up to 70% load, with room for a table doubling
 
 typedef struct {
     DirQueue* q;
@@ -17,46 +22,25 @@ typedef struct {
     volatile LONG* shutdown;
     Pattern* pats;
     int patCount;
+    RuleProfile* profiles;      // --profile: one per thread, merged after the scan
+    volatile LONG nextProfile;
     wchar_t root[MAX_PATH_LEN];
     int threadCount;
+    TreeDiff* diff;
+    DiskUsage* du;      // --du: sum accepted files per directory instead of listing them
+    IdSet* seen;        // files already printed
+    IdSet* dirs;        // directories already listed (--follow-symlinks only)
+    int follow, xdev;
+    int archives;       // list .zip/.tar members as if the archive were a directory
+    DWORD rootVol;
+    int sched;
+    int localCap;
+    int maxDepth;               // -1: unlimited
+    LONG maxResults;            // -1: unlimited
+    volatile LONG* results;
 } ThreadArg;
 
-/* -------- deduplication structures -------- */
-typedef struct SeenNode {
-    wchar_t* path;
-    struct SeenNode* next;
-} SeenNode;
-
-static SeenNode* seenHead = NULL;
-static CRITICAL_SECTION seenCS;
-
-static int SeenAlready(const wchar_t* path) {
-    SeenNode* node = seenHead;
-    while(node) {
-        if(!wcscmp(node->path, path)) return 1; // already seen
-        node = node->next;
-    }
-    return 0;
-}
-
-static void AddToSeen(const wchar_t* path) {
-    SeenNode* node = malloc(sizeof(SeenNode));
-    if(!node) { fwprintf(stderr,L"alloc failed\n"); return; }
-    node->path = _wcsdup(path); 
-    if(!node->path) { free(node); return; }
-    node->next = seenHead;
-    seenHead = node;
-}
-
 /* -------- path helpers -------- */
-static void path_concat(wchar_t* out,size_t outLen,const wchar_t* base,const wchar_t* name){
-    size_t len=wcslen(base);
-    if(len>0 && base[len-1]!=L'\\' && base[len-1]!=L'/') 
-        swprintf(out,outLen,L"%s\\%s",base,name);
-    else 
-        swprintf(out,outLen,L"%s%s",base,name);
-}
-
 static int normalize_root(const wchar_t* in,wchar_t* out,size_t outLen){
     wchar_t abs[MAX_PATH_LEN];
     DWORD n=GetFullPathNameW(in,MAX_PATH_LEN,abs,NULL); 
@@ -69,37 +53,179 @@ static int normalize_root(const wchar_t* in,wchar_t* out,size_t outLen){
     return 1;
 }
 
+/* -------- scheduling -------- */
+#define SCHED_BFS   0   // shared FIFO
+#define SCHED_DFS   1   // shared LIFO
+#define SCHED_LOCAL 2   // per-thread stack, shared only with idle threads
+
+#define LOCAL_CAP   1024
+
+typedef struct {
+    DirItem* items;
+    int count, cap;
+} LocalStack;
+
+static void stop_all(ThreadArg* a){
+    *a->shutdown=1;
+    q_close(a->q);
+    for(int i=0;i<a->threadCount;i++) ReleaseSemaphore(a->q->itemsSem,1,NULL);
+}
+
+// A lost directory would keep inflight above zero forever: a spill I/O failure ends the scan
+static void push_item(ThreadArg* a, const DirItem* item){
+    if(!q_push_item(a->q,item) && a->q->failed) stop_all(a);
+}
+
 /* -------- enqueue helper -------- */
-static __forceinline void enqueue_dir(DirQueue* q, volatile LONG* inflight, const wchar_t* dir){
+// kind: 0 for a directory, ARCHIVE_* for an archive listed in its place
+// parent: the enclosing directory's --du node (NULL for the root)
+static __forceinline void enqueue_dir(ThreadArg* a, LocalStack* local, const wchar_t* dir, int depth, int kind, DuNode* parent){
     if(!dir || wcslen(dir)==0) return; // skip empty
-    wchar_t* dirCopy = _wcsdup(dir);
-    InterlockedIncrement(inflight);
-    q_push(q, dirCopy);
+    DuNode* node=NULL;
+    if(a->du && !(node=du_node(a->du,parent,dir))){ fwprintf(stderr,L"alloc failed, not counted: %s\n",dir); return; }
+    InterlockedIncrement(a->inflight);
+    if(local && local->count<local->cap){
+        DirItem* it=&local->items[local->count++];
+        wcscpy_s(it->path,MAX_PATH_LEN,dir); it->depth=depth; it->kind=kind; it->ctx=node;
+        return;
+    }
+    DirItem item;
+    wcscpy_s(item.path,MAX_PATH_LEN,dir); item.depth=depth; item.kind=kind; item.ctx=node;
+    push_item(a,&item);
+}
+
+// Hand the oldest (shallowest, usually largest) pending subtrees to threads waiting for work;
+// everything else stays on this thread, next to its siblings.
+static void share_work(ThreadArg* a, LocalStack* local){
+    int n=0;
+    while(n<local->count-1 && a->q->waiting>n){ push_item(a,&local->items[n]); n++; }
+    if(n){ memmove(local->items,local->items+n,(local->count-n)*sizeof(DirItem)); local->count-=n; }
+}
+
+/* -------- rule evaluation -------- */
+static __forceinline int ignored(ThreadArg* a, RuleProfile* prof, const wchar_t* rel, int isDir){
+    return prof ? is_ignored_profiled(rel,isDir,a->pats,a->patCount,prof) : is_ignored(rel,isDir,a->pats,a->patCount);
+}
+
+/* -------- output -------- */
+static void emit_file(ThreadArg* a, const wchar_t* path){
+    if(a->maxResults<0){ wprintf(L"%s\n", path); return; }
+    LONG n=InterlockedIncrement(a->results);
+    if(n<=a->maxResults) wprintf(L"%s\n", path);
+    if(n==a->maxResults){ fflush(stdout); stop_all(a); }
+}
+
+// One visit per file, however many names (hardlinks, followed links) reach it
+static int first_visit(ThreadArg* a, const DirEnum* de, const wchar_t* fullPath, int isLink){
+    DWORD vol=de->vol; FileId id=de->fileId;
+    if(isLink && a->follow && !file_identity(fullPath,&vol,&id)){ vol=de->vol; id=de->fileId; }
+    return (!id.lo && !id.hi) || idset_add(a->seen,vol,id);
+}
+
+/* -------- archives -------- */
+// Members are matched as <archive rel>/<member path>, every parent folder inside the archive
+// is checked as a directory first, and --max-depth counts those folders like real ones.
+static void scan_archive(ThreadArg* a, RuleProfile* prof, const DirItem* item, wchar_t* fullPath, wchar_t* relBuf, ULONGLONG* bytes, ULONGLONG* files){
+    ArchiveEnum* e=malloc(sizeof(ArchiveEnum));
+    wchar_t* parent=malloc(MAX_PATH_LEN*sizeof(wchar_t));
+    if(!e||!parent){ free(e); free(parent); return; }
+    if(!ae_open(e,item->path,item->kind)){
+        // Not readable as an archive after all: list it as the plain file it is
+        fwprintf(stderr,L"Cannot read archive %s, listed as a file\n",item->path);
+        if(a->du){ *bytes+=e->fileSize; (*files)++; } // fileSize is set once the file opened
+        else emit_file(a,item->path);
+        free(e); free(parent); return;
+    }
+
+    size_t rootLen=wcslen(a->root);
+    const wchar_t* rel=item->path+rootLen;
+    if(*rel==L'\\'||*rel==L'/') rel++;
+    wcscpy_s(relBuf,MAX_PATH_LEN,rel);
+    to_forward_slashes(relBuf);
+    size_t prefixLen=wcslen(relBuf);
+    parent[0]=0;
+    int parentIgnored=0;
+
+    while(!*a->shutdown && ae_next(e)){
+        if(e->isDir) continue; // folders show up through the files below them
+        if(prefixLen+1+wcslen(e->name)>=MAX_PATH_LEN) continue;
+        relBuf[prefixLen]=L'/';
+        wcscpy_s(relBuf+prefixLen+1,MAX_PATH_LEN-prefixLen-1,e->name);
+
+        int segs=1;
+        for(const wchar_t* c=e->name;*c;c++) if(*c==L'/') segs++;
+        if(a->maxDepth>=0 && item->depth+segs-1>=a->maxDepth) continue;
+
+        // Members of one folder are usually stored together: reuse the last folder's verdict
+        wchar_t* slash=wcsrchr(relBuf+prefixLen+1,L'/');
+        if(slash){
+            *slash=0;
+            if(wcscmp(parent,relBuf)!=0){
+                wcscpy_s(parent,MAX_PATH_LEN,relBuf);
+                parentIgnored=0;
+                for(wchar_t* c=relBuf+prefixLen+1;!parentIgnored;c++){
+                    if(*c!=L'/' && *c!=0) continue;
+                    wchar_t save=*c; *c=0;
+                    parentIgnored=ignored(a,prof,relBuf,1);
+                    *c=save;
+                    if(save==0) break;
+                }
+            }
+            *slash=L'/';
+            if(parentIgnored) continue;
+        }
+        if(ignored(a,prof,relBuf,0)) continue;
+
+        if(a->du){ *bytes+=e->size; (*files)++; continue; }
+        path_concat(fullPath,MAX_PATH_LEN,item->path,e->name);
+        for(wchar_t* c=fullPath+wcslen(item->path);*c;c++) if(*c==L'/') *c=L'\\';
+        emit_file(a,fullPath);
+    }
+    if(e->readError) fwprintf(stderr,L"Archive became unreadable, members listed so far only: %s\n",item->path);
+    ae_close(e);
+    free(e); free(parent);
 }
 
 /* -------- worker -------- */
 static DWORD WINAPI worker(LPVOID param){
     ThreadArg* a=(ThreadArg*)param;
-    wchar_t* dir=malloc(MAX_PATH_LEN*sizeof(wchar_t));
-    wchar_t* search=malloc(MAX_PATH_LEN*sizeof(wchar_t));
+    DirItem* item=malloc(sizeof(DirItem));
     wchar_t* fullPath=malloc(MAX_PATH_LEN*sizeof(wchar_t));
     wchar_t* relBuf=malloc(MAX_PATH_LEN*sizeof(wchar_t));
-    if(!dir||!search||!fullPath||!relBuf){ fwprintf(stderr,L"Heap allocation failed\n"); return 1; }
+    LocalStack local={0};
+    if(a->sched==SCHED_LOCAL){ local.cap=a->localCap; local.items=malloc(local.cap*sizeof(DirItem)); }
+    DirEnum de;
+    if(!item||!fullPath||!relBuf||(a->sched==SCHED_LOCAL && !local.items)||!de_init(&de)){ fwprintf(stderr,L"Heap allocation failed\n"); return 1; }
+    LocalStack* mine = a->sched==SCHED_LOCAL ? &local : NULL;
+    RuleProfile* prof = a->profiles ? &a->profiles[InterlockedIncrement(&a->nextProfile)-1] : NULL;
+
+    // Diff/index runs collect each directory's accepted entries and compare them as a unit
+    int collect = a->diff && (a->diff->mode!=DIFF_NONE || a->diff->indexOut);
+    DiffList cur={0};
 
     for(;;){
-        if(!q_pop(a->q, dir, a->shutdown)) break;
-        wchar_t* dirPtr = _wcsdup(dir); // optional, if q_pop returns pointer
+        if(local.count) *item=local.items[--local.count];
+        else if(!q_pop_item(a->q, item, a->shutdown)){ if(a->q->failed) stop_all(a); break; }
+        if(*a->shutdown) break; // stopped early with local work left
 
+        wchar_t* dir=item->path;
         size_t L=wcslen(dir);
-        if(L && (dir[L-1]==L'\\'||dir[L-1]==L'/')) swprintf(search,MAX_PATH_LEN,L"%s*",dir);
-        else swprintf(search,MAX_PATH_LEN,L"%s\\*",dir);
-
-        WIN32_FIND_DATAW ffd; HANDLE h=FindFirstFileW(search,&ffd);
-        if(h!=INVALID_HANDLE_VALUE){
-            do{
-                if(!wcscmp(ffd.cFileName,L".")||!wcscmp(ffd.cFileName,L"..")) continue;
-
-                path_concat(fullPath,MAX_PATH_LEN,dir,ffd.cFileName);
+        int descend = a->maxDepth<0 || item->depth+1<a->maxDepth;
+        int dup=0, skip=0;
+        ULONGLONG bytes=0, files=0; // --du: this directory's own accepted files
+
+        if(item->kind!=ARCHIVE_NONE){
+            scan_archive(a,prof,item,fullPath,relBuf,&bytes,&files);
+        } else if(de_open(&de,dir)){
+            // Decided on the opened directory, i.e. after any link leading here was resolved
+            dup = a->follow && !idset_add(a->dirs,de.vol,de.dirId); // loop or already reached via another link
+            skip = dup || (a->xdev && de.vol!=a->rootVol);
+            while(!skip && !*a->shutdown && de_next(&de)){
+                int isDir = (de.attrs & FILE_ATTRIBUTE_DIRECTORY) ? 1 : 0;
+                int isLink = de_is_link(&de);
+                if(isDir && isLink && !a->follow) continue; // symlinks, junctions and mount points
+
+                path_concat(fullPath,MAX_PATH_LEN,dir,de.name);
 
                 size_t rootLen=wcslen(a->root);
                 const wchar_t* rel=fullPath+rootLen; 
@@ -108,53 +234,79 @@ static DWORD WINAPI worker(LPVOID param){
                 to_forward_slashes(relBuf);
                 if(relBuf[0]==0) continue;
 
-                int isDir = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? 1 : 0;
-                if(is_ignored(relBuf,isDir,a->pats,a->patCount)) continue;
+                // Archives stand in for directories in plain listings; diff/index runs compare them as files
+                int arc = (!isDir && a->archives && !collect) ? archive_kind(de.name) : ARCHIVE_NONE;
+                if(ignored(a,prof,relBuf,isDir||arc)) continue;
 
-                if(isDir){
-                    // copy fullPath for queue
-                    wchar_t* dirCopy = _wcsdup(fullPath);
-                    enqueue_dir(a->q,a->inflight,dirCopy);
+                if(collect) list_add(&cur,de.name,isDir,de.size,de.mtime);
+
+                if(arc){
+                    if(descend && first_visit(a,&de,fullPath,isLink)) enqueue_dir(a,mine,fullPath,item->depth+1,arc,item->ctx);
+                } else if(isDir){
+                    if(descend) enqueue_dir(a,mine,fullPath,item->depth+1,0,item->ctx);
+                } else if(collect && a->diff->mode!=DIFF_NONE){
+                    continue; // reported as A/R/M records by diff_dir
                 } else { 
-                    EnterCriticalSection(&seenCS);
-                    if(!SeenAlready(relBuf)) {
-                        AddToSeen(relBuf);
-                        // copy fullPath for printing
-                        wchar_t printBuf[MAX_PATH_LEN];
-                        wcscpy_s(printBuf, MAX_PATH_LEN, fullPath);
-                        if(wcscmp(dir, L"")==0) { LeaveCriticalSection(&seenCS);continue; } // skip empty relative paths
-                        
-                        /*struct stat fileStat;
-                        if(stat(wchar_to_utf8(fullPath), &fileStat) != 0) {
-                            fwprintf(stderr,L"Unable to get file stats for: %s\n", fullPath);
-                            return 1;
-                        }
-
-                        wprintf(L"%s|%lld\n", printBuf, (long long)fileStat.st_size);*/
-                        wprintf(L"%s\n", printBuf);
-                    }
-                    LeaveCriticalSection(&seenCS);
+                    if(!first_visit(a,&de,fullPath,isLink)) continue;
+                    if(a->du){ bytes+=de.size; files++; }
+                    else emit_file(a,fullPath);
                 }
+            }
+            de_close(&de);
+        } else if(collect){
+            fwprintf(stderr,L"Cannot list %s, compared as unchanged\n",dir);
+            skip=1;
+        }
 
-            }while(FindNextFileW(h,&ffd));
-            FindClose(h);
+        if(collect && !*a->shutdown){
+            size_t rootLen=wcslen(a->root);
+            const wchar_t* rel=dir+(L>=rootLen ? rootLen : L);
+            if(*rel==L'\\'||*rel==L'/') rel++;
+            wcscpy_s(relBuf,MAX_PATH_LEN,rel);
+            to_forward_slashes(relBuf);
+            // Not entered (other volume, or already listed under another name) or unreadable:
+            // the baseline below it stands
+            if(skip) diff_keep_dir(a->diff,relBuf);
+            else diff_dir(a->diff,dir,relBuf,&cur);
         }
+        list_clear(&cur);
 
-        free(dirPtr);
+        if(a->du) du_finish_dir(a->du,item->ctx,bytes,files);
 
-        if(InterlockedDecrement(a->inflight)==0){
-            *a->shutdown=1;
-            for(int i=0;i<a->threadCount;i++) ReleaseSemaphore(a->q->itemsSem,1,NULL);
-        }
+        if(mine) share_work(a,mine);
+
+        if(InterlockedDecrement(a->inflight)==0) stop_all(a);
     }
 
-    free(dir); free(search); free(fullPath); free(relBuf);
+    list_free(&cur);
+    de_free(&de);
+    free(local.items);
+    free(item); free(fullPath); free(relBuf);
     return 0;
 }
 
 /* -------- main -------- */
+static void usage(const wchar_t* exe){
+    fwprintf(stderr,L"Usage: %s <root> [threads] [options]\n",exe);
+    fwprintf(stderr,L"  --diff <dir|index>    report A|/R|/M| records against a second root or an index\n");
+    fwprintf(stderr,L"  --write-index <file>  write a per-directory index usable as a later --diff baseline\n");
+    fwprintf(stderr,L"  --hash                compare/record content hashes in addition to size and mtime\n");
+    fwprintf(stderr,L"  --follow-symlinks     descend into symlinks and junctions; each directory is listed once\n");
+    fwprintf(stderr,L"  --xdev                do not cross onto other volumes\n");
+    fwprintf(stderr,L"  --archives            list members of .zip and .tar files as if they were folders\n");
+    fwprintf(stderr,L"  --du                  print total size and file count per directory, largest first\n");
+    fwprintf(stderr,L"  --du-depth <n>        with --du, report directories at most n levels below the root\n");
+    fwprintf(stderr,L"  --profile             report per-rule evaluation counts and matching time on stderr\n");
+    fwprintf(stderr,L"  --explain <path>      show which .filterignore rule decides <path>, then exit\n");
+    fwprintf(stderr,L"  --sched <bfs|dfs|local>  traversal order (default bfs)\n");
+    fwprintf(stderr,L"  --max-depth <n>       list at most n levels below the root (1: root only)\n");
+    fwprintf(stderr,L"  --max-results <n>     stop all workers after n files have been printed\n");
+    fwprintf(stderr,L"  --mem-budget <MB>     spill pending directories and dedup ids to disk beyond this\n");
+    fwprintf(stderr,L"  --spill-dir <dir>     where spill files go (default: %%TEMP%%)\n");
+}
+
 int wmain(int argc,wchar_t* argv[]){
-    if(argc<2){ fwprintf(stderr,L"Usage: %s <root> [threads]\n",argv[0]); return 2; }
+    if(argc<2){ usage(argv[0]); return 2; }
 
     wchar_t root[MAX_PATH_LEN];
     if(!normalize_root(argv[1],root,MAX_PATH_LEN)){ fwprintf(stderr,L"Failed to resolve root: %s\n",argv[1]); return 3; }
@@ -162,28 +314,143 @@ int wmain(int argc,wchar_t* argv[]){
     if(attr==INVALID_FILE_ATTRIBUTES || !(attr&FILE_ATTRIBUTE_DIRECTORY)){ fwprintf(stderr,L"Path is not a directory: %s\n",root); return 3; }
 
     int threads=1; 
-    if(argc>=3){ 
+    int argi=2;
+    if(argc>=3 && wcsncmp(argv[2],L"--",2)){ 
         threads=_wtoi(argv[2]); 
         if(threads<1) threads=1; 
         if(threads>MAX_THREADS) threads=MAX_THREADS; 
+        argi=3;
+    }
+
+    const wchar_t* diffPath=NULL; const wchar_t* indexOut=NULL; int useHash=0, follow=0, xdev=0, archives=0;
+    int sched=SCHED_BFS, maxDepth=-1; LONG maxResults=-1;
+    int memBudget=0; const wchar_t* spillDir=NULL;
+    int duMode=0, duDepth=-1;
+    int profile=0; const wchar_t* explain=NULL;
+    for(;argi<argc;argi++){
+        if(!wcscmp(argv[argi],L"--diff") && argi+1<argc) diffPath=argv[++argi];
+        else if(!wcscmp(argv[argi],L"--write-index") && argi+1<argc) indexOut=argv[++argi];
+        else if(!wcscmp(argv[argi],L"--hash")) useHash=1;
+        else if(!wcscmp(argv[argi],L"--follow-symlinks")) follow=1;
+        else if(!wcscmp(argv[argi],L"--xdev")) xdev=1;
+        else if(!wcscmp(argv[argi],L"--archives")) archives=1;
+        else if(!wcscmp(argv[argi],L"--du")) duMode=1;
+        else if(!wcscmp(argv[argi],L"--du-depth") && argi+1<argc){ duMode=1; duDepth=_wtoi(argv[++argi]); if(duDepth<0) duDepth=0; }
+        else if(!wcscmp(argv[argi],L"--profile")) profile=1;
+        else if(!wcscmp(argv[argi],L"--explain") && argi+1<argc) explain=argv[++argi];
+        else if(!wcscmp(argv[argi],L"--sched") && argi+1<argc){
+            const wchar_t* v=argv[++argi];
+            if(!wcscmp(v,L"bfs")) sched=SCHED_BFS;
+            else if(!wcscmp(v,L"dfs")) sched=SCHED_DFS;
+            else if(!wcscmp(v,L"local")) sched=SCHED_LOCAL;
+            else { fwprintf(stderr,L"Unknown schedule: %s\n",v); usage(argv[0]); return 2; }
+        }
+        else if(!wcscmp(argv[argi],L"--max-depth") && argi+1<argc){ maxDepth=_wtoi(argv[++argi]); if(maxDepth<0) maxDepth=0; }
+        else if(!wcscmp(argv[argi],L"--max-results") && argi+1<argc){ maxResults=_wtoi(argv[++argi]); if(maxResults<0) maxResults=0; }
+        else if(!wcscmp(argv[argi],L"--mem-budget") && argi+1<argc){ memBudget=_wtoi(argv[++argi]); if(memBudget<1) memBudget=1; }
+        else if(!wcscmp(argv[argi],L"--spill-dir") && argi+1<argc) spillDir=argv[++argi];
+        else { fwprintf(stderr,L"Unknown option: %s\n",argv[argi]); usage(argv[0]); return 2; }
+    }
+    // A cut-off walk would make every directory it skipped look removed (or missing from the index)
+    if((diffPath || indexOut) && (maxDepth>=0 || maxResults>=0)){
+        fwprintf(stderr,L"--max-depth and --max-results cannot be combined with --diff or --write-index\n"); return 2;
+    }
+    // An index holds a linked directory under whichever name the threads reached first
+    if(follow && (indexOut || (diffPath && !(GetFileAttributesW(diffPath)&FILE_ATTRIBUTE_DIRECTORY)))){
+        fwprintf(stderr,L"--follow-symlinks cannot be combined with --write-index or an index --diff baseline\n"); return 2;
+    }
+    if(duMode && (diffPath || indexOut || maxResults>=0)){
+        fwprintf(stderr,L"--du cannot be combined with --diff, --write-index or --max-results\n"); return 2;
     }
 
     Pattern* pats = malloc(sizeof(Pattern)*MAX_PATTERNS); 
     if(!pats){ fwprintf(stderr,L"alloc patterns failed\n"); return 1; }
     int patCount = load_patterns(root, pats);
 
+    if(explain){
+        // Accept a path under <root> or one relative to it (never to the current directory)
+        wchar_t full[MAX_PATH_LEN], rel[MAX_PATH_LEN];
+        size_t rootLen=wcslen(root)-1; // without the trailing backslash
+        size_t EL=wcslen(explain);
+        int isDir = EL>0 && (explain[EL-1]==L'\\'||explain[EL-1]==L'/');
+        int absolute = (explain[0] && explain[1]==L':') || explain[0]==L'\\' || explain[0]==L'/';
+        if(!absolute) path_concat(rel,MAX_PATH_LEN,root,explain);
+        DWORD n=GetFullPathNameW(absolute ? explain : rel,MAX_PATH_LEN,full,NULL);
+        if(n==0 || n>=MAX_PATH_LEN || _wcsnicmp(full,root,rootLen) || (full[rootLen] && full[rootLen]!=L'\\')){
+            fwprintf(stderr,L"Not under %s: %s\n",root,explain); free(pats); return 2;
+        }
+        wcscpy_s(rel,MAX_PATH_LEN,full+rootLen);
+        to_forward_slashes(rel);
+        size_t L=wcslen(rel);
+        while(L>0 && rel[L-1]==L'/') rel[--L]=0;
+        wchar_t* r=rel;
+        while(*r==L'/') r++;
+        if(!*r){ fwprintf(stderr,L"Nothing to explain: %s\n",explain); free(pats); return 2; }
+        path_concat(full,MAX_PATH_LEN,root,r);
+        DWORD eattr=GetFileAttributesW(full);
+        if(eattr!=INVALID_FILE_ATTRIBUTES && (eattr&FILE_ATTRIBUTE_DIRECTORY)) isDir=1;
+        explain_path(r,isDir,pats,patCount);
+        free(pats);
+        return 0;
+    }
+
+    TreeDiff diff;
+    diff_init(&diff,root,pats,patCount,useHash);
+    diff.follow=follow; diff.xdev=xdev;
+    if(diffPath){
+        wchar_t base[MAX_PATH_LEN];
+        DWORD battr=GetFileAttributesW(diffPath);
+        if(battr!=INVALID_FILE_ATTRIBUTES && (battr&FILE_ATTRIBUTE_DIRECTORY)){
+            if(!normalize_root(diffPath,base,MAX_PATH_LEN)){ fwprintf(stderr,L"Failed to resolve root: %s\n",diffPath); return 3; }
+        } else wcscpy_s(base,MAX_PATH_LEN,diffPath);
+        if(!diff_set_baseline(&diff,base)) return 3;
+    }
+    if(indexOut && !diff_set_index_out(&diff,indexOut)) return 3;
+
     DirQueue q={0};
     if(!q_init(&q)){ fwprintf(stderr,L"Queue init failed\n"); free(pats); q_destroy(&q); return 1; }
 
-    volatile LONG inflight=0, shutdown=0;
-    enqueue_dir(&q,&inflight,root);
+    q.lifo = sched==SCHED_DFS;
+
+    // Budget split: 1/8 queue ring, 1/8 per-thread stacks, 1/2 file ids, 1/8 directory ids
+    size_t budget=(size_t)memBudget<<20;
+    int localCap=LOCAL_CAP;
+    if(budget){
+        if(!q_enable_spill(&q,(LONG)(budget/8/sizeof(DirItem)),spillDir)){ fwprintf(stderr,L"Failed to create spill file\n"); return 1; }
+        size_t perThread=budget/8/threads/sizeof(DirItem);
+        localCap= perThread<16 ? 16 : perThread>LOCAL_CAP ? LOCAL_CAP : (int)perThread;
+    }
+
+    volatile LONG inflight=0, shutdown=0, results=0;
 
     ThreadArg a={0};
     a.q=&q; a.inflight=&inflight; a.shutdown=&shutdown;
     a.pats=pats; a.patCount=patCount; wcscpy_s(a.root,MAX_PATH_LEN,root);
     a.threadCount=threads;
+    a.diff=&diff;
+    RuleProfile profiles[MAX_THREADS];
+    if(profile){
+        for(int i=0;i<threads;i++) if(!profile_init(&profiles[i],patCount)){ fwprintf(stderr,L"alloc profile failed\n"); return 1; }
+        a.profiles=profiles;
+    }
+    DiskUsage du;
+    du_init(&du,duDepth);
+    if(duMode) a.du=&du;
+    a.follow=follow; a.xdev=xdev; a.archives=archives;
+    a.sched=sched; a.localCap=localCap; a.maxDepth=maxDepth; a.maxResults=maxResults; a.results=&results;
+
+    IdSet seen, dirs;
+    if(!idset_init(&seen)||!idset_init(&dirs)){ fwprintf(stderr,L"alloc dedup set failed\n"); return 1; }
+    if(budget && (!idset_set_budget(&seen,budget/2/BUDGET_BYTES_PER_ID,spillDir)
+               || (follow && !idset_set_budget(&dirs,budget/8/BUDGET_BYTES_PER_ID,spillDir)))){
+        fwprintf(stderr,L"Failed to create spill file\n"); return 1;
+    }
+    a.seen=&seen; a.dirs=&dirs;
+    FileId rootId;
+    if(!file_identity(root,&a.rootVol,&rootId)){ fwprintf(stderr,L"Failed to open root: %s\n",root); return 3; }
 
-    InitializeCriticalSection(&seenCS);  // init dedup CS
+    if(maxDepth==0 || maxResults==0) shutdown=1; // nothing may be printed
+    else enqueue_dir(&a,NULL,root,0,0,NULL);
 
     HANDLE th[MAX_THREADS]={0};
     for(int i=0;i<threads;i++){
@@ -194,18 +461,24 @@ int wmain(int argc,wchar_t* argv[]){
     WaitForMultipleObjects(threads,th,TRUE,INFINITE);
     for(int i=0;i<threads;i++) if(th[i]) CloseHandle(th[i]);
 
-    // free deduplication list
-    EnterCriticalSection(&seenCS);
-    SeenNode* node = seenHead;
-    while(node){
-        SeenNode* next = node->next;
-        free(node->path);
-        free(node);
-        node = next;
+    if(q.failed){
+        // Directories were lost: an incomplete diff or total would be misleading
+        fwprintf(stderr,L"Scan aborted: the spill file could not be written or read\n");
+        idset_destroy(&seen); idset_destroy(&dirs); q_destroy(&q); free(pats);
+        return 1;
+    }
+
+    diff_finish(&diff);
+    if(duMode){ du_report(&du); du_free(&du); }
+    if(profile){
+        fflush(stdout);
+        for(int i=1;i<threads;i++) profile_merge(&profiles[0],&profiles[i],patCount);
+        profile_report(&profiles[0],pats,patCount);
+        for(int i=0;i<threads;i++) profile_free(&profiles[i]);
     }
-    LeaveCriticalSection(&seenCS);
-    DeleteCriticalSection(&seenCS);
 
+    idset_destroy(&seen);
+    idset_destroy(&dirs);
     q_destroy(&q);
     free(pats);
 
@@ -1,6 +1,15 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
 #include "pattern_matching.h"
 
+static int rule_matches(const wchar_t* relForward,const Pattern* p,unsigned long long* calls){
+    if(p->anchored) return match_glob_counted(relForward,p->text,1,calls);
+    if(p->dirOnly){ (*calls)++; return contains_dir_segment(relForward,p->text); }
+    for(const wchar_t* s=relForward;*s;s++) if(match_glob_counted(s,p->text,1,calls)) return 1;
+    return 0;
+}
+
 int is_ignored(const wchar_t* relForward,int isDir,Pattern* pats,int n){
     int ignore=0;
     for(int i=0;i<n;i++){
@@ -23,10 +32,11 @@ int load_patterns(const wchar_t* root,Pattern* out){
         fwprintf(stderr,L"Failed to open pattern file: %s\n",fp);
         exit(1);
     }
-    int count=0; wchar_t line[MAX_PATH_LEN];
+    int count=0, lineNo=0; wchar_t line[MAX_PATH_LEN];
     while(fgetws(line,MAX_PATH_LEN,f)){
+        lineNo++;
         trim_ws(line); wchar_t* hash=wcschr(line,L'#'); if(hash){*hash=0; trim_ws(line);} if(!line[0]) continue;
-        Pattern* p=&out[count]; p->neg=0; p->anchored=0; p->dirOnly=0;
+        Pattern* p=&out[count]; p->neg=0; p->anchored=0; p->dirOnly=0; p->line=lineNo;
         if(line[0]==L'!'){ p->neg=1; wcscpy_s(p->text,MAX_PATH_LEN,line+1);} else wcscpy_s(p->text,MAX_PATH_LEN,line);
         trim_ws(p->text);
         if(p->text[0]==L'/'){ p->anchored=1; memmove(p->text,p->text+1,(wcslen(p->text))*sizeof(wchar_t)); }
@@ -35,4 +45,123 @@ int load_patterns(const wchar_t* root,Pattern* out){
         if(p->text[0]){ count++; if(count>=MAX_PATTERNS) break; }
     }
     fclose(f); return count;
-}
\ No newline at end of file
+}
+
+/* -------- profiling -------- */
+int profile_init(RuleProfile* p,int n){
+    p->stats=calloc(n?n:1,sizeof(PatternStats));
+    p->hits=malloc((n?n:1)*sizeof(int));
+    p->tested=0;
+    return p->stats && p->hits;
+}
+
+void profile_free(RuleProfile* p){
+    free(p->stats); free(p->hits);
+    p->stats=NULL; p->hits=NULL;
+}
+
+void profile_merge(RuleProfile* into,const RuleProfile* from,int n){
+    into->tested+=from->tested;
+    for(int i=0;i<n;i++){
+        PatternStats* a=&into->stats[i]; const PatternStats* b=&from->stats[i];
+        a->evaluated+=b->evaluated; a->matched+=b->matched; a->overridden+=b->overridden;
+        a->calls+=b->calls; a->slow+=b->slow; a->ticks+=b->ticks;
+    }
+}
+
+// Same verdict as is_ignored, plus per-rule counters and timings
+int is_ignored_profiled(const wchar_t* relForward,int isDir,Pattern* pats,int n,RuleProfile* prof){
+    int ignore=0, hitCount=0;
+    unsigned long long bound=(unsigned long long)(wcslen(relForward)+1);
+    bound*=bound;
+    prof->tested++;
+    for(int i=0;i<n;i++){
+        Pattern* p=&pats[i]; if(p->dirOnly && !isDir) continue;
+        PatternStats* st=&prof->stats[i];
+        unsigned long long calls=0;
+        LARGE_INTEGER t0,t1;
+        QueryPerformanceCounter(&t0);
+        int matched=rule_matches(relForward,p,&calls);
+        QueryPerformanceCounter(&t1);
+        st->evaluated++; st->calls+=calls; st->ticks+=t1.QuadPart-t0.QuadPart;
+        if(calls>bound) st->slow++;
+        if(matched){ ignore=!p->neg; st->matched++; prof->hits[hitCount++]=i; }
+    }
+    for(int k=0;k<hitCount;k++){
+        Pattern* p=&pats[prof->hits[k]];
+        if(p->neg==ignore) prof->stats[prof->hits[k]].overridden++;
+    }
+    return ignore;
+}
+
+static void print_rule(FILE* out,const Pattern* p){
+    fwprintf(out,L"%s%s%s%s",p->neg?L"!":L"",p->anchored?L"/":L"",p->text,p->dirOnly?L"/":L"");
+}
+
+static int cmp_ticks_desc(const void* a,const void* b){
+    const PatternStats* x=((const PatternStats* const*)a)[0];
+    const PatternStats* y=((const PatternStats* const*)b)[0];
+    return x->ticks<y->ticks ? 1 : x->ticks>y->ticks ? -1 : 0;
+}
+
+// Most expensive rules first, to stderr so it does not mix with the listing
+void profile_report(const RuleProfile* p,Pattern* pats,int n){
+    LARGE_INTEGER freq; QueryPerformanceFrequency(&freq);
+    const PatternStats** order=malloc((n?n:1)*sizeof(PatternStats*));
+    if(!order){ fwprintf(stderr,L"alloc failed\n"); return; }
+    for(int i=0;i<n;i++) order[i]=&p->stats[i];
+    qsort(order,n,sizeof(PatternStats*),cmp_ticks_desc);
+
+    fwprintf(stderr,L"\nRule profile: %llu paths tested against %d rules\n",p->tested,n);
+    fwprintf(stderr,L"%6s %12s %10s %10s %10s %10s  %-22s %s\n",L"line",L"evaluated",L"matched",L"overridden",L"time(ms)",L"calls/eval",L"flags",L"rule");
+    int dead=0, slow=0;
+    for(int k=0;k<n;k++){
+        const PatternStats* st=order[k];
+        const Pattern* pat=&pats[st-p->stats];
+        wchar_t flags[64]=L"";
+        if(!st->matched){ wcscat_s(flags,64,L"dead "); dead++; }
+        else if(st->overridden==st->matched) wcscat_s(flags,64,L"always-overridden ");
+        if(st->slow){ wcscat_s(flags,64,L"backtracking"); slow++; }
+        double ms=freq.QuadPart ? st->ticks*1000.0/freq.QuadPart : 0;
+        double perEval=st->evaluated ? (double)st->calls/st->evaluated : 0;
+        fwprintf(stderr,L"%6d %12llu %10llu %10llu %10.3f %10.1f  %-22s ",pat->line,st->evaluated,st->matched,st->overridden,ms,perEval,flags);
+        print_rule(stderr,pat);
+        fwprintf(stderr,L"\n");
+    }
+    fwprintf(stderr,L"%d dead rule(s), %d rule(s) with pathological backtracking\n",dead,slow);
+    free(order);
+}
+
+/* -------- explain -------- */
+// Walks the path the way the scan does: an ignored parent directory is never entered,
+// so it decides for everything below it; otherwise the last matching rule wins.
+int explain_path(const wchar_t* relForward,int isDir,Pattern* pats,int n){
+    wchar_t buf[MAX_PATH_LEN];
+    wcscpy_s(buf,MAX_PATH_LEN,relForward);
+    unsigned long long calls=0;
+    wprintf(L"%s%s\n",relForward,isDir?L"/":L"");
+    for(wchar_t* c=buf;*c;c++){
+        if(*c!=L'/') continue;
+        *c=0;
+        int decider=-1;
+        for(int i=0;i<n;i++) if(rule_matches(buf,&pats[i],&calls)) decider=i;
+        if(decider>=0 && !pats[decider].neg){
+            wprintf(L"  => ignored: parent directory '%s' is excluded by line %d: ",buf,pats[decider].line);
+            print_rule(stdout,&pats[decider]); wprintf(L"\n");
+            return 1;
+        }
+        *c=L'/';
+    }
+
+    int decider=-1;
+    for(int i=0;i<n;i++){
+        Pattern* p=&pats[i];
+        if(p->dirOnly && !isDir) continue;
+        if(!rule_matches(relForward,p,&calls)) continue;
+        wprintf(L"  line %d matches: ",p->line); print_rule(stdout,p); wprintf(L"\n");
+        decider=i;
+    }
+    if(decider<0){ wprintf(L"  => included: no rule matches\n"); return 0; }
+    wprintf(L"  => %s by line %d\n",pats[decider].neg?L"included":L"ignored",pats[decider].line);
+    return !pats[decider].neg;
+}
@@ -10,9 +10,33 @@
 typedef struct {
     wchar_t text[MAX_PATH_LEN];
     int neg, anchored, dirOnly;
+    int line;                  // line in .filterignore
 } Pattern;
 
+// --profile: counters for one rule, kept per thread and merged after the scan
+typedef struct {
+    unsigned long long evaluated;   // paths the rule was tried on
+    unsigned long long matched;
+    unsigned long long overridden;  // matched, but a later rule decided the other way
+    unsigned long long calls;       // match_glob invocations, including backtracking
+    unsigned long long slow;        // evaluations needing more than (len+1)^2 calls
+    long long ticks;                // QueryPerformanceCounter time spent matching
+} PatternStats;
+
+typedef struct {
+    PatternStats* stats;            // one per pattern
+    int* hits;                      // scratch: rules that matched the current path
+    unsigned long long tested;      // paths run through the rules
+} RuleProfile;
+
 int is_ignored(const wchar_t* relForward,int isDir,Pattern* pats,int n);
 int load_patterns(const wchar_t* root,Pattern* out);
 
+int profile_init(RuleProfile* p,int n);
+void profile_free(RuleProfile* p);
+void profile_merge(RuleProfile* into,const RuleProfile* from,int n);
+int is_ignored_profiled(const wchar_t* relForward,int isDir,Pattern* pats,int n,RuleProfile* prof);
+void profile_report(const RuleProfile* p,Pattern* pats,int n);
+int explain_path(const wchar_t* relForward,int isDir,Pattern* pats,int n);
+
 #endif // PATTERN_MATCHING_H
\ No newline at end of file
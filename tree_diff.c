@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tree_diff.h"
+#include "Utils/dir_enum.h"
+
+#define INDEX_LINE_LEN (MAX_PATH_LEN+96)
+#define HASH_BUF_LEN   65536
+
+/* -------- entry lists -------- */
+void list_add(DiffList* l,const wchar_t* name,int isDir,ULONGLONG size,ULONGLONG mtime){
+    if(l->count==l->cap){
+        int cap=l->cap? l->cap*2 : 64;
+        DiffEntry* items=realloc(l->items,cap*sizeof(DiffEntry));
+        if(!items){ fwprintf(stderr,L"alloc failed\n"); return; }
+        l->items=items; l->cap=cap;
+    }
+    DiffEntry* e=&l->items[l->count];
+    e->name=_wcsdup(name); if(!e->name) return;
+    e->isDir=isDir; e->size=size; e->mtime=mtime; e->hash=0;
+    l->count++;
+}
+
+void list_clear(DiffList* l){
+    for(int i=0;i<l->count;i++) free(l->items[i].name);
+    l->count=0;
+}
+
+void list_free(DiffList* l){
+    list_clear(l); free(l->items);
+    l->items=NULL; l->cap=0;
+}
+
+static int cmp_entry(const void* a,const void* b){
+    return _wcsicmp(((const DiffEntry*)a)->name,((const DiffEntry*)b)->name);
+}
+
+/* -------- content hash (FNV-1a 64) -------- */
+ULONGLONG hash_file(const wchar_t* path){
+    HANDLE h=CreateFileW(path,GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+    if(h==INVALID_HANDLE_VALUE) return 0;
+    BYTE* buf=malloc(HASH_BUF_LEN);
+    if(!buf){ CloseHandle(h); return 0; }
+    ULONGLONG hv=14695981039346656037ULL; DWORD got=0;
+    while(ReadFile(h,buf,HASH_BUF_LEN,&got,NULL) && got>0){
+        for(DWORD i=0;i<got;i++){ hv^=buf[i]; hv*=1099511628211ULL; }
+    }
+    free(buf); CloseHandle(h);
+    return hv;
+}
+
+/* -------- index table: rel dir -> block offset -------- */
+static ULONGLONG rel_hash(const wchar_t* s){
+    ULONGLONG hv=14695981039346656037ULL;
+    for(;*s;s++){ wchar_t c=*s; if(c>=L'A'&&c<=L'Z') c+=32; hv^=c; hv*=1099511628211ULL; }
+    return hv;
+}
+
+static IndexDir* dir_find(TreeDiff* d,const wchar_t* rel){
+    if(!d->dirCap) return NULL;
+    size_t i=(size_t)(rel_hash(rel)&(d->dirCap-1));
+    while(d->dirs[i].rel){
+        if(!_wcsicmp(d->dirs[i].rel,rel)) return &d->dirs[i];
+        i=(i+1)&(d->dirCap-1);
+    }
+    return NULL;
+}
+
+static int dir_grow(TreeDiff* d){
+    size_t cap=d->dirCap? d->dirCap*2 : 1024;
+    IndexDir* dirs=calloc(cap,sizeof(IndexDir));
+    if(!dirs) return 0;
+    for(size_t k=0;k<d->dirCap;k++){
+        if(!d->dirs[k].rel) continue;
+        size_t i=(size_t)(rel_hash(d->dirs[k].rel)&(cap-1));
+        while(dirs[i].rel) i=(i+1)&(cap-1);
+        dirs[i]=d->dirs[k];
+    }
+    free(d->dirs); d->dirs=dirs; d->dirCap=cap;
+    return 1;
+}
+
+static IndexDir* dir_insert(TreeDiff* d,const wchar_t* rel){
+    if((d->dirCount+1)*2>d->dirCap && !dir_grow(d)) return NULL;
+    IndexDir* e=dir_find(d,rel);
+    if(e) return e;
+    size_t i=(size_t)(rel_hash(rel)&(d->dirCap-1));
+    while(d->dirs[i].rel) i=(i+1)&(d->dirCap-1);
+    d->dirs[i].rel=_wcsdup(rel); if(!d->dirs[i].rel) return NULL;
+    d->dirCount++;
+    return &d->dirs[i];
+}
+
+/* -------- index I/O (UTF-8, one block per directory) -------- */
+static void utf8_line(const char* in,wchar_t* out,int outLen){
+    if(!MultiByteToWideChar(CP_UTF8,0,in,-1,out,outLen)) out[0]=0;
+    size_t n=wcslen(out);
+    while(n>0 && (out[n-1]==L'\n'||out[n-1]==L'\r')) out[--n]=0;
+}
+
+static void put_utf8(FILE* f,const wchar_t* line){
+    char buf[INDEX_LINE_LEN*3];
+    if(WideCharToMultiByte(CP_UTF8,0,line,-1,buf,sizeof(buf),NULL,NULL)>0) fputs(buf,f);
+}
+
+static int load_index(TreeDiff* d){
+    char line[INDEX_LINE_LEN*3]; wchar_t wline[INDEX_LINE_LEN];
+    for(;;){
+        __int64 off=_ftelli64(d->indexIn);
+        if(!fgets(line,sizeof(line),d->indexIn)) break;
+        if(line[0]!='D'||line[1]!='|') continue;
+        utf8_line(line+2,wline,INDEX_LINE_LEN);
+        IndexDir* e=dir_insert(d,wline);
+        if(!e){ fwprintf(stderr,L"alloc failed\n"); return 0; }
+        e->offset=off;
+    }
+    return 1;
+}
+
+static void read_block(TreeDiff* d,IndexDir* e,DiffList* out){
+    char line[INDEX_LINE_LEN*3]; wchar_t wline[INDEX_LINE_LEN];
+    EnterCriticalSection(&d->inCS);
+    _fseeki64(d->indexIn,e->offset,SEEK_SET);
+    fgets(line,sizeof(line),d->indexIn); // the block's own D| line
+    while(fgets(line,sizeof(line),d->indexIn)){
+        if(line[0]=='D'&&line[1]=='|') break;
+        if(line[0]!='F'||line[1]!='|') continue;
+        utf8_line(line+2,wline,INDEX_LINE_LEN);
+        // F|name|size|mtime|hash — names cannot contain '|', parse from the right
+        ULONGLONG v[3]={0}; int ok=1;
+        for(int i=2;i>=0;i--){
+            wchar_t* bar=wcsrchr(wline,L'|'); if(!bar){ ok=0; break; }
+            v[i]=_wcstoui64(bar+1,NULL,10); *bar=0;
+        }
+        if(!ok||!wline[0]) continue;
+        list_add(out,wline,0,v[0],v[1]);
+        out->items[out->count-1].hash=v[2];
+    }
+    LeaveCriticalSection(&d->inCS);
+}
+
+static void write_block(TreeDiff* d,const wchar_t* relDir,DiffList* cur){
+    wchar_t line[INDEX_LINE_LEN];
+    EnterCriticalSection(&d->outCS);
+    swprintf(line,INDEX_LINE_LEN,L"D|%s\n",relDir); put_utf8(d->indexOut,line);
+    for(int i=0;i<cur->count;i++){
+        DiffEntry* e=&cur->items[i]; if(e->isDir) continue;
+        swprintf(line,INDEX_LINE_LEN,L"F|%s|%llu|%llu|%llu\n",e->name,e->size,e->mtime,e->hash);
+        put_utf8(d->indexOut,line);
+    }
+    LeaveCriticalSection(&d->outCS);
+}
+
+// Copies a baseline block to the new index verbatim
+static void copy_block(TreeDiff* d,IndexDir* e){
+    char line[INDEX_LINE_LEN*3];
+    EnterCriticalSection(&d->inCS);
+    EnterCriticalSection(&d->outCS);
+    _fseeki64(d->indexIn,e->offset,SEEK_SET);
+    if(fgets(line,sizeof(line),d->indexIn)) fputs(line,d->indexOut);
+    while(fgets(line,sizeof(line),d->indexIn)){
+        if(line[0]=='D'&&line[1]=='|') break;
+        fputs(line,d->indexOut);
+    }
+    LeaveCriticalSection(&d->outCS);
+    LeaveCriticalSection(&d->inCS);
+}
+
+/* -------- second-root listing -------- */
+static void child_rel(wchar_t* out,size_t outLen,const wchar_t* relDir,const wchar_t* name){
+    if(relDir[0]) swprintf(out,outLen,L"%s/%s",relDir,name);
+    else wcscpy_s(out,outLen,name);
+}
+
+// Baseline directories opened on the way down from the one being diffed (loop check)
+typedef struct DirChain {
+    DWORD vol;
+    FileId id;
+    const struct DirChain* up;
+} DirChain;
+
+#define LIST_MISSING  0   // no such directory: the baseline side is empty
+#define LIST_OK       1
+#define LIST_SKIPPED  (-1) // not entered: unreadable, another volume with --xdev, or a loop
+
+// Lists the baseline side with the rules the scan applies to the current side: directory
+// links only when following, each directory once per chain, one volume with --xdev.
+static int list_dir(TreeDiff* d,const wchar_t* dir,const wchar_t* relDir,DiffList* out,const DirChain* up,DirChain* self){
+    wchar_t rel[MAX_PATH_LEN];
+    if(GetFileAttributesW(dir)==INVALID_FILE_ATTRIBUTES) return LIST_MISSING;
+    DirEnum de;
+    if(!de_init(&de)){ fwprintf(stderr,L"alloc failed\n"); return LIST_SKIPPED; }
+    if(!de_open(&de,dir)){
+        fwprintf(stderr,L"Cannot list baseline %s, compared as unchanged\n",dir);
+        de_free(&de); return LIST_SKIPPED;
+    }
+    int skip= d->xdev && de.vol!=d->otherVol;
+    for(const DirChain* c=up;c && !skip;c=c->up) if(c->vol==de.vol && c->id.lo==de.dirId.lo && c->id.hi==de.dirId.hi) skip=1;
+    if(self){ self->vol=de.vol; self->id=de.dirId; self->up=up; }
+    while(!skip && de_next(&de)){
+        int isDir=(de.attrs & FILE_ATTRIBUTE_DIRECTORY) ? 1 : 0;
+        if(isDir && de_is_link(&de) && !d->follow) continue;
+        child_rel(rel,MAX_PATH_LEN,relDir,de.name);
+        if(is_ignored(rel,isDir,d->pats,d->patCount)) continue;
+        list_add(out,de.name,isDir,de.size,de.mtime);
+    }
+    de_free(&de);
+    return skip ? LIST_SKIPPED : LIST_OK;
+}
+
+/* -------- records -------- */
+// Records are always reported against the scanned root, even for removed entries.
+static void rel_to_dir(TreeDiff* d,const wchar_t* relDir,wchar_t* out,size_t outLen){
+    path_concat(out,outLen,d->root,relDir);
+    for(wchar_t* s=out;*s;s++) if(*s==L'/') *s=L'\\';
+}
+
+static void print_rec(TreeDiff* d,wchar_t tag,const wchar_t* dir,const wchar_t* name){
+    wchar_t path[MAX_PATH_LEN];
+    path_concat(path,MAX_PATH_LEN,dir,name);
+    fwprintf(d->out,L"%c|%s\n",tag,path);
+}
+
+static void emit_removed_tree(TreeDiff* d,const wchar_t* otherDir,const wchar_t* relDir,const DirChain* up){
+    DiffList l={0};
+    DirChain self;
+    wchar_t curDir[MAX_PATH_LEN], sub[MAX_PATH_LEN], rel[MAX_PATH_LEN];
+    if(list_dir(d,otherDir,relDir,&l,up,&self)!=LIST_OK){ list_free(&l); return; }
+    rel_to_dir(d,relDir,curDir,MAX_PATH_LEN);
+    for(int i=0;i<l.count;i++){
+        DiffEntry* e=&l.items[i];
+        if(!e->isDir){ print_rec(d,L'R',curDir,e->name); continue; }
+        path_concat(sub,MAX_PATH_LEN,otherDir,e->name);
+        child_rel(rel,MAX_PATH_LEN,relDir,e->name);
+        emit_removed_tree(d,sub,rel,&self);
+    }
+    list_free(&l);
+}
+
+static int is_modified(TreeDiff* d,const wchar_t* dir,const wchar_t* otherDir,DiffEntry* c,DiffEntry* b){
+    if(c->size!=b->size) return 1;
+    if(d->useHash){
+        wchar_t path[MAX_PATH_LEN];
+        if(!c->hash){ path_concat(path,MAX_PATH_LEN,dir,c->name); c->hash=hash_file(path); }
+        if(!b->hash && otherDir){ path_concat(path,MAX_PATH_LEN,otherDir,b->name); b->hash=hash_file(path); }
+        if(c->hash && b->hash) return c->hash!=b->hash;
+    }
+    return c->mtime!=b->mtime;
+}
+
+/* -------- public -------- */
+void diff_init(TreeDiff* d,const wchar_t* root,Pattern* pats,int patCount,int useHash){
+    memset(d,0,sizeof(*d));
+    wcscpy_s(d->root,MAX_PATH_LEN,root);
+    d->out=stdout;
+    d->pats=pats; d->patCount=patCount; d->useHash=useHash;
+    InitializeCriticalSection(&d->inCS);
+    InitializeCriticalSection(&d->outCS);
+}
+
+int diff_set_baseline(TreeDiff* d,const wchar_t* path){
+    DWORD attr=GetFileAttributesW(path);
+    if(attr==INVALID_FILE_ATTRIBUTES){ fwprintf(stderr,L"Baseline not found: %s\n",path); return 0; }
+    if(attr & FILE_ATTRIBUTE_DIRECTORY){
+        wcscpy_s(d->otherRoot,MAX_PATH_LEN,path);
+        FileId id;
+        if(!file_identity(path,&d->otherVol,&id)){ fwprintf(stderr,L"Cannot open baseline: %s\n",path); return 0; }
+        d->mode=DIFF_ROOT;
+        return 1;
+    }
+    if(_wfopen_s(&d->indexIn,path,L"rb")!=0 || !d->indexIn){ fwprintf(stderr,L"Failed to open index: %s\n",path); return 0; }
+    if(!load_index(d)) return 0;
+    d->mode=DIFF_INDEX;
+    return 1;
+}
+
+int diff_set_index_out(TreeDiff* d,const wchar_t* path){
+    if(_wfopen_s(&d->indexOut,path,L"wb")!=0 || !d->indexOut){ fwprintf(stderr,L"Failed to create index: %s\n",path); return 0; }
+    return 1;
+}
+
+// Compares one directory of the current scan against the same directory of the baseline.
+// Subdirectories present on both sides are left to the traversal; only baseline-only
+// subtrees are walked here.
+void diff_dir(TreeDiff* d,const wchar_t* dir,const wchar_t* relDir,DiffList* cur){
+    if(d->indexOut){
+        if(d->useHash){
+            wchar_t path[MAX_PATH_LEN];
+            for(int i=0;i<cur->count;i++){
+                DiffEntry* e=&cur->items[i]; if(e->isDir||e->hash) continue;
+                path_concat(path,MAX_PATH_LEN,dir,e->name); e->hash=hash_file(path);
+            }
+        }
+        write_block(d,relDir,cur);
+    }
+    if(d->mode==DIFF_NONE) return;
+
+    DiffList base={0};
+    DirChain self={0};
+    wchar_t otherDir[MAX_PATH_LEN], sub[MAX_PATH_LEN], rel[MAX_PATH_LEN];
+    if(d->mode==DIFF_ROOT){
+        path_concat(otherDir,MAX_PATH_LEN,d->otherRoot,relDir);
+        for(wchar_t* s=otherDir;*s;s++) if(*s==L'/') *s=L'\\';
+        if(list_dir(d,otherDir,relDir,&base,NULL,&self)==LIST_SKIPPED){ list_free(&base); return; }
+    } else {
+        IndexDir* e=dir_find(d,relDir);
+        if(e){ InterlockedExchange(&e->visited,1); read_block(d,e,&base); }
+    }
+
+    qsort(cur->items,cur->count,sizeof(DiffEntry),cmp_entry);
+    qsort(base.items,base.count,sizeof(DiffEntry),cmp_entry);
+
+    int i=0, j=0;
+    while(i<cur->count || j<base.count){
+        DiffEntry* c= i<cur->count ? &cur->items[i] : NULL;
+        DiffEntry* b= j<base.count ? &base.items[j] : NULL;
+        int cmp= !c ? 1 : !b ? -1 : _wcsicmp(c->name,b->name);
+        if(cmp==0 && c->isDir!=b->isDir) cmp= c->isDir ? 1 : -1; // type changed: report both sides
+        if(cmp<0){
+            if(!c->isDir) print_rec(d,L'A',dir,c->name);
+            i++;
+        } else if(cmp>0){
+            if(!b->isDir) print_rec(d,L'R',dir,b->name);
+            else if(d->mode==DIFF_ROOT){
+                path_concat(sub,MAX_PATH_LEN,otherDir,b->name);
+                child_rel(rel,MAX_PATH_LEN,relDir,b->name);
+                emit_removed_tree(d,sub,rel,&self);
+            }
+            j++;
+        } else {
+            if(!c->isDir && is_modified(d,dir,d->mode==DIFF_ROOT? otherDir : NULL,c,b)) print_rec(d,L'M',dir,c->name);
+            i++; j++;
+        }
+    }
+    list_free(&base);
+}
+
+// For a directory the scan did not list (unreadable, or on another volume with --xdev):
+// its baseline blocks and those below it are taken as unchanged rather than removed, and
+// carried over to the new index.
+void diff_keep_dir(TreeDiff* d,const wchar_t* relDir){
+    if(d->mode!=DIFF_INDEX) return;
+    size_t n=wcslen(relDir);
+    for(size_t k=0;k<d->dirCap;k++){
+        IndexDir* e=&d->dirs[k];
+        if(!e->rel) continue;
+        if(n && (_wcsnicmp(e->rel,relDir,n) || (e->rel[n] && e->rel[n]!=L'/'))) continue;
+        if(InterlockedExchange(&e->visited,1)) continue;
+        if(d->indexOut) copy_block(d,e);
+    }
+}
+
+void diff_finish(TreeDiff* d){
+    if(d->mode==DIFF_INDEX){
+        // Directories the scan never reached are gone (or now ignored) as a whole
+        wchar_t curDir[MAX_PATH_LEN];
+        for(size_t k=0;k<d->dirCap;k++){
+            IndexDir* e=&d->dirs[k];
+            if(!e->rel || e->visited) continue;
+            DiffList base={0};
+            read_block(d,e,&base);
+            rel_to_dir(d,e->rel,curDir,MAX_PATH_LEN);
+            for(int i=0;i<base.count;i++) print_rec(d,L'R',curDir,base.items[i].name);
+            list_free(&base);
+        }
+    }
+    for(size_t k=0;k<d->dirCap;k++) free(d->dirs[k].rel);
+    free(d->dirs);
+    if(d->indexIn) fclose(d->indexIn);
+    if(d->indexOut) fclose(d->indexOut);
+    DeleteCriticalSection(&d->inCS);
+    DeleteCriticalSection(&d->outCS);
+}
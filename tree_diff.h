@@ -0,0 +1,64 @@
+#ifndef TREE_DIFF_H
+#define TREE_DIFF_H
+
+#include <windows.h>
+#include <stdio.h>
+#include "Utils/path_queue.h"
+#include "pattern_matching.h"
+
+#define DIFF_NONE  0
+#define DIFF_ROOT  1   // baseline is a second directory tree
+#define DIFF_INDEX 2   // baseline is an index written by --write-index
+
+typedef struct {
+    wchar_t* name;
+    int isDir;
+    ULONGLONG size;
+    ULONGLONG mtime;   // FILETIME ticks
+    ULONGLONG hash;    // 0 when not computed
+} DiffEntry;
+
+typedef struct {
+    DiffEntry* items;
+    int count, cap;
+} DiffList;
+
+typedef struct {
+    wchar_t* rel;
+    __int64 offset;
+    volatile LONG visited;
+} IndexDir;
+
+typedef struct {
+    int mode;
+    int useHash;
+    FILE* out;                  // A|/R|/M| records, stdout
+    wchar_t root[MAX_PATH_LEN];
+    wchar_t otherRoot[MAX_PATH_LEN];
+    DWORD otherVol;
+    int follow, xdev;           // DIFF_ROOT: walk the baseline by the scan's link and volume rules
+    Pattern* pats;
+    int patCount;
+
+    FILE* indexIn;              // DIFF_INDEX: baseline, read one directory block at a time
+    CRITICAL_SECTION inCS;
+    IndexDir* dirs;             // rel dir -> block offset (open addressing)
+    size_t dirCap, dirCount;
+
+    FILE* indexOut;             // --write-index
+    CRITICAL_SECTION outCS;
+} TreeDiff;
+
+void list_add(DiffList* l,const wchar_t* name,int isDir,ULONGLONG size,ULONGLONG mtime);
+void list_clear(DiffList* l);
+void list_free(DiffList* l);
+ULONGLONG hash_file(const wchar_t* path);
+
+void diff_init(TreeDiff* d,const wchar_t* root,Pattern* pats,int patCount,int useHash);
+int diff_set_baseline(TreeDiff* d,const wchar_t* path);
+int diff_set_index_out(TreeDiff* d,const wchar_t* path);
+void diff_dir(TreeDiff* d,const wchar_t* dir,const wchar_t* relDir,DiffList* cur);
+void diff_keep_dir(TreeDiff* d,const wchar_t* relDir);
+void diff_finish(TreeDiff* d);
+
+#endif // TREE_DIFF_H